@@ -0,0 +1,603 @@
+/*
+ * Pixel pipeline logic shared by the LS020 fbdev and DRM drivers and the
+ * userspace simulator: change detection, dirty tile merging, pixel packing
+ * and the panel register sequences. Nothing in here touches SPI, GPIOs or
+ * driver state.
+ */
+#ifndef _LS020_CORE_H
+#define _LS020_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/bitmap.h>
+#include <linux/string.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define BITS_TO_LONGS(nr) DIV_ROUND_UP(nr, BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+#define IS_ALIGNED(x, a) (((x) & ((a) - 1)) == 0)
+#define min(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a > _b ? _a : _b; })
+
+static inline bool test_bit(unsigned long nr, const unsigned long *addr)
+{
+	return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline void set_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline unsigned long find_next_bit(const unsigned long *addr, unsigned long size,
+					  unsigned long offset)
+{
+	for (; offset < size; offset++)
+		if (test_bit(offset, addr))
+			break;
+	return offset < size ? offset : size;
+}
+
+static inline unsigned long find_next_zero_bit(const unsigned long *addr, unsigned long size,
+					       unsigned long offset)
+{
+	for (; offset < size; offset++)
+		if (!test_bit(offset, addr))
+			break;
+	return offset < size ? offset : size;
+}
+
+#define for_each_set_bit(bit, addr, size)				\
+	for ((bit) = find_next_bit((addr), (size), 0); (bit) < (size);	\
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline unsigned int bitmap_weight(const unsigned long *src, unsigned int nbits)
+{
+	unsigned int bit, w = 0;
+	
+	for_each_set_bit(bit, src, nbits)
+		w++;
+	return w;
+}
+
+static inline bool bitmap_empty(const unsigned long *src, unsigned int nbits)
+{
+	return find_next_bit(src, nbits, 0) == nbits;
+}
+
+static inline bool bitmap_full(const unsigned long *src, unsigned int nbits)
+{
+	return find_next_zero_bit(src, nbits, 0) == nbits;
+}
+#endif
+
+#define LS020_WIDTH 176
+#define LS020_HEIGHT 132
+#define LS020_FRAME_SIZE (LS020_WIDTH * LS020_HEIGHT * 2)
+
+#define LS020_TILE_SIZE 16
+#define LS020_TILES_X DIV_ROUND_UP(LS020_WIDTH, LS020_TILE_SIZE)
+#define LS020_TILES_Y DIV_ROUND_UP(LS020_HEIGHT, LS020_TILE_SIZE)
+#define LS020_NUM_TILES (LS020_TILES_X * LS020_TILES_Y)
+#define LS020_MAX_RECTS 8
+
+/* Packed pixel data is queued in chunks the size of this many RGB565 rows */
+#define LS020_CHUNK_ROWS 16
+
+#define LS020_ROW_WORDS ((int)(LS020_WIDTH * 2 / sizeof(unsigned long)))
+#define LS020_TILE_WORDS ((int)(LS020_TILE_SIZE * 2 / sizeof(unsigned long)))
+
+/* Register writes are (register, value) pairs; 0xEF selects the bank */
+#define LS020_WINDOW_CMD_LEN 14
+#define LS020_ROTATION_CMD_LEN 6
+#define LS020_COLOR8_CMD_LEN 6
+
+/* Power-on sequence, sent in two parts with a 7 ms pause in between */
+static const u8 ls020_init_array_0[] = {
+	0xEF, 0x00, 0xEE, 0x04, 0x1B, 0x04, 0xFE, 0xFE,
+	0xFE, 0xFE, 0xEF, 0x90, 0x4A, 0x04, 0x7F, 0x3F,
+	0xEE, 0x04, 0x43, 0x06
+};
+
+static const u8 ls020_init_array_1[] = {
+	0xEF, 0x90, 0x09, 0x83, 0x08, 0x00, 0x0B, 0xAF,
+	0x0A, 0x00, 0x05, 0x00, 0x06, 0x00, 0x07, 0x00,
+	0xEF, 0x00, 0xEE, 0x0C, 0xEF, 0x90, 0x00, 0x80,
+	0xEF, 0xB0, 0x49, 0x02, 0xEF, 0x00, 0x7F, 0x01,
+	0xE1, 0x81, 0xE2, 0x02, 0xE2, 0x76, 0xE1, 0x83,
+	0x80, 0x01, 0xEF, 0x90, 0x00, 0x00
+};
+
+/* Display off and power-down; the init sequence after a reset wakes it again */
+static const u8 ls020_off_array[] = {
+	0xEF, 0x00, 0x7E, 0x04, 0xEF, 0xB0, 0x5A, 0x48,
+	0xEF, 0x00, 0x7F, 0x01, 0xEF, 0xB0, 0x64, 0xFF,
+	0x65, 0x00, 0xEF, 0x00, 0x7F, 0x01, 0xE2, 0x62,
+	0xE2, 0x02, 0xEF, 0xB0, 0xBC, 0x02, 0xEF, 0x00,
+	0x7F, 0x01, 0xE2, 0x00, 0x80, 0x00, 0xE2, 0x04,
+	0xE2, 0x00, 0xE1, 0x00, 0xEF, 0xB0, 0xBC, 0x00,
+	0xEF, 0x00, 0x7F, 0x01
+};
+
+struct ls020_rect {
+	u8 x0, y0;
+	u8 x1, y1;
+};
+
+static inline void ls020_mark_tile(unsigned long *tiles, int tile)
+{
+	if (!test_bit(tile, tiles))
+		set_bit(tile, tiles);
+}
+
+static inline void ls020_diff_row_scalar(const u16 *vrow, const u16 *srow,
+					 unsigned long *tiles, int tile_row)
+{
+	int x;
+	
+	for (x = 0; x < LS020_WIDTH; x++) {
+		if (vrow[x] != srow[x])
+			ls020_mark_tile(tiles, tile_row + x / LS020_TILE_SIZE);
+	}
+}
+
+/*
+ * Word-wise diff of one scanline. Equal rows are rejected with a single
+ * memcmp(); otherwise the first and last differing words bound the change,
+ * and only the tiles strictly between them need to be looked at again.
+ * @vrow may be rewritten through mmap meanwhile, so the scans are bounded
+ * and a row that turned equal again is left alone.
+ */
+static inline void ls020_diff_row_words(const u16 *vrow, const u16 *srow,
+					unsigned long *tiles, int tile_row)
+{
+	const unsigned long *v = (const unsigned long *)vrow;
+	const unsigned long *s = (const unsigned long *)srow;
+	int first, last, tx, i;
+	
+	if (!memcmp(v, s, LS020_WIDTH * 2))
+		return;
+	
+	for (first = 0; first < LS020_ROW_WORDS && v[first] == s[first]; first++)
+		;
+	if (first == LS020_ROW_WORDS)
+		return;
+	for (last = LS020_ROW_WORDS - 1; last > first && v[last] == s[last]; last--)
+		;
+	
+	ls020_mark_tile(tiles, tile_row + first / LS020_TILE_WORDS);
+	ls020_mark_tile(tiles, tile_row + last / LS020_TILE_WORDS);
+	
+	for (tx = first / LS020_TILE_WORDS + 1; tx < last / LS020_TILE_WORDS; tx++) {
+		unsigned long diff = 0;
+		
+		for (i = tx * LS020_TILE_WORDS; i < (tx + 1) * LS020_TILE_WORDS; i++)
+			diff |= v[i] ^ s[i];
+		if (diff)
+			ls020_mark_tile(tiles, tile_row + tx);
+	}
+}
+
+static inline void ls020_diff_rows(const u16 *vmem, unsigned int stride, const u16 *shadow,
+				   const unsigned long *rows, unsigned long *tiles)
+{
+	bool aligned = IS_ALIGNED((unsigned long)vmem, sizeof(unsigned long)) &&
+		       IS_ALIGNED((unsigned long)shadow, sizeof(unsigned long));
+	unsigned int y;
+	
+	for_each_set_bit(y, rows, LS020_HEIGHT) {
+		const u16 *vrow = vmem + y * stride;
+		const u16 *srow = shadow + y * LS020_WIDTH;
+		int tile_row = (y / LS020_TILE_SIZE) * LS020_TILES_X;
+		
+		if (aligned)
+			ls020_diff_row_words(vrow, srow, tiles, tile_row);
+		else
+			ls020_diff_row_scalar(vrow, srow, tiles, tile_row);
+	}
+}
+
+static inline void ls020_tiles_bbox(const unsigned long *tiles, struct ls020_rect *r)
+{
+	unsigned int bit;
+	
+	r->x0 = LS020_TILES_X - 1;
+	r->y0 = LS020_TILES_Y - 1;
+	r->x1 = 0;
+	r->y1 = 0;
+	
+	for_each_set_bit(bit, tiles, LS020_NUM_TILES) {
+		u8 tx = bit % LS020_TILES_X;
+		u8 ty = bit / LS020_TILES_X;
+		
+		r->x0 = min(r->x0, tx);
+		r->y0 = min(r->y0, ty);
+		r->x1 = max(r->x1, tx);
+		r->y1 = max(r->y1, ty);
+	}
+}
+
+/*
+ * Merges dirty tiles into rectangles in tile units: runs of tiles within a
+ * tile row become spans, and identical spans on consecutive tile rows are
+ * joined. Falls back to one bounding box when there are too many pieces.
+ */
+static inline int ls020_tiles_to_rects(const unsigned long *tiles, struct ls020_rect *rects)
+{
+	int n = 0, i, ty;
+	
+	for (ty = 0; ty < LS020_TILES_Y; ty++) {
+		unsigned long start = ty * LS020_TILES_X;
+		unsigned long end = start + LS020_TILES_X;
+		unsigned long first, last = start;
+		
+		while ((first = find_next_bit(tiles, end, last)) < end) {
+			u8 x0, x1;
+			
+			last = find_next_zero_bit(tiles, end, first);
+			x0 = first - start;
+			x1 = last - start - 1;
+			
+			for (i = 0; i < n; i++) {
+				if (rects[i].x0 == x0 && rects[i].x1 == x1 &&
+				    rects[i].y1 == ty - 1) {
+					rects[i].y1 = ty;
+					break;
+				}
+			}
+			if (i < n)
+				continue;
+			
+			if (n == LS020_MAX_RECTS) {
+				ls020_tiles_bbox(tiles, &rects[0]);
+				return 1;
+			}
+			rects[n].x0 = x0;
+			rects[n].y0 = ty;
+			rects[n].x1 = x1;
+			rects[n].y1 = ty;
+			n++;
+		}
+	}
+	
+	return n;
+}
+
+/*
+ * Decides how a set of dirty tiles goes out: returns the number of partial
+ * rectangles written to @rects, 0 when nothing changed, or -1 when every
+ * tile is dirty and a full frame is cheaper.
+ */
+static inline int ls020_plan_update(const unsigned long *tiles, struct ls020_rect *rects)
+{
+	if (bitmap_empty(tiles, LS020_NUM_TILES))
+		return 0;
+	if (bitmap_full(tiles, LS020_NUM_TILES))
+		return -1;
+	return ls020_tiles_to_rects(tiles, rects);
+}
+
+/* Converts a rectangle in tile units to inclusive pixel coordinates */
+static inline void ls020_tile_rect_pixels(const struct ls020_rect *tr, struct ls020_rect *px)
+{
+	px->x0 = tr->x0 * LS020_TILE_SIZE;
+	px->y0 = tr->y0 * LS020_TILE_SIZE;
+	px->x1 = min((tr->x1 + 1) * LS020_TILE_SIZE, LS020_WIDTH) - 1;
+	px->y1 = min((tr->y1 + 1) * LS020_TILE_SIZE, LS020_HEIGHT) - 1;
+}
+
+/*
+ * With 16-bit SPI words the controller shifts each native-endian pixel out
+ * MSB first, so rows are copied as is. Otherwise pixels are byte-swapped
+ * into big-endian order for 8-bit transfers.
+ */
+static inline void ls020_pack_pixels(u8 *dst, const u16 *src, int count, bool bpw16)
+{
+	int i;
+	
+	if (bpw16) {
+		memcpy(dst, src, count * 2);
+		return;
+	}
+	
+	for (i = 0; i < count; i++) {
+		dst[i << 1] = src[i] >> 8;
+		dst[(i << 1) + 1] = src[i] & 0xFF;
+	}
+}
+
+/* 4x4 ordered dither thresholds for the 8-bit colour mode */
+static const u8 ls020_bayer4[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+/*
+ * RGB565 to the panel's RGB332. With @dither, the bits that are dropped
+ * are offset by the Bayer threshold of the pixel position first.
+ */
+static inline u8 ls020_rgb332(u16 color, int x, int y, bool dither)
+{
+	unsigned int r = color >> 11;
+	unsigned int g = (color >> 5) & 0x3F;
+	unsigned int b = color & 0x1F;
+	
+	if (dither) {
+		unsigned int t = ls020_bayer4[y & 3][x & 3];
+		
+		r = min(r + (t >> 2), 31u);
+		g = min(g + (t >> 1), 63u);
+		b = min(b + (t >> 1), 31u);
+	}
+	
+	return (r >> 2) << 5 | (g >> 3) << 2 | b >> 3;
+}
+
+/* Packs one row starting at logical (@x, @y) as one byte per pixel */
+static inline void ls020_pack_pixels8(u8 *dst, const u16 *src, int count, int x, int y,
+				      bool dither)
+{
+	int i;
+	
+	for (i = 0; i < count; i++)
+		dst[i] = ls020_rgb332(src[i], x + i, y, dither);
+}
+
+/*
+ * Builds the register writes that open an address window in logical
+ * coordinates for the given orientation. Returns the number of bytes.
+ */
+static inline int ls020_window_cmds(u8 *cmd, u8 orientation, u8 x0, u8 y0, u8 x1, u8 y1)
+{
+	u8 r08, r09, r0a, r0b, r06, r07;
+	
+	switch (orientation & 3) {
+	case 1:
+		r08 = x0;
+		r09 = x1;
+		r0a = y0;
+		r0b = y1;
+		r06 = x0;
+		r07 = y0;
+		break;
+	case 2:
+		r08 = (LS020_HEIGHT - 1) - y0;
+		r09 = (LS020_HEIGHT - 1) - y1;
+		r0a = x0;
+		r0b = x1;
+		r06 = (LS020_HEIGHT - 1) - y0;
+		r07 = x0;
+		break;
+	case 3:
+		r08 = (LS020_HEIGHT - 1) - x0;
+		r09 = (LS020_HEIGHT - 1) - x1;
+		r0a = (LS020_WIDTH - 1) - y0;
+		r0b = (LS020_WIDTH - 1) - y1;
+		r06 = (LS020_HEIGHT - 1) - x0;
+		r07 = (LS020_WIDTH - 1) - y0;
+		break;
+	default:
+		r08 = y0;
+		r09 = y1;
+		r0a = (LS020_WIDTH - 1) - x0;
+		r0b = (LS020_WIDTH - 1) - x1;
+		r06 = y0;
+		r07 = (LS020_WIDTH - 1) - x0;
+		break;
+	}
+	
+	cmd[0] = 0xEF;
+	cmd[1] = 0x90;
+	cmd[2] = 0x08;
+	cmd[3] = r08;
+	cmd[4] = 0x09;
+	cmd[5] = r09;
+	cmd[6] = 0x0A;
+	cmd[7] = r0a;
+	cmd[8] = 0x0B;
+	cmd[9] = r0b;
+	cmd[10] = 0x06;
+	cmd[11] = r06;
+	cmd[12] = 0x07;
+	cmd[13] = r07;
+	
+	return LS020_WINDOW_CMD_LEN;
+}
+
+/* Scan direction registers for each orientation. Returns the number of bytes. */
+static inline int ls020_rotation_cmds(u8 *cmd, u8 orientation)
+{
+	static const u8 regs[4][2] = {
+		{ 0x40, 0x04 },
+		{ 0x00, 0x00 },
+		{ 0x80, 0x04 },
+		{ 0xC0, 0x00 },
+	};
+	
+	cmd[0] = 0xEF;
+	cmd[1] = 0x90;
+	cmd[2] = 0x01;
+	cmd[3] = regs[orientation & 3][0];
+	cmd[4] = 0x05;
+	cmd[5] = regs[orientation & 3][1];
+	
+	return LS020_ROTATION_CMD_LEN;
+}
+
+/*
+ * Switches the pixel interface to 8-bit RGB332: register 0xE8 of bank 0x00.
+ * Bank 0x90 is selected again afterwards, as at the end of the init sequence.
+ */
+static inline int ls020_color8_cmds(u8 *cmd)
+{
+	static const u8 seq[LS020_COLOR8_CMD_LEN] = {
+		0xEF, 0x00, 0xE8, 0x00, 0xEF, 0x90
+	};
+	
+	memcpy(cmd, seq, sizeof(seq));
+	return LS020_COLOR8_CMD_LEN;
+}
+
+/*
+ * Reference model of the panel's addressing, used to check command and pixel
+ * streams without hardware. It tracks the bank 0x90 registers, decodes the
+ * window back into logical coordinates for the orientation selected by
+ * 0x01/0x05, and writes pixel data into @image. Only orientations 0 and 2
+ * are modelled: how the controller maps a 176x132 frame at 90 and 270
+ * degrees has not been confirmed on hardware. The address counter wraps
+ * to the window origin after the last pixel, as on the real controller.
+ * In 8-bit colour mode @image holds the RGB332 byte of each pixel.
+ */
+struct ls020_model {
+	u8 bank;
+	u8 regs[256];
+	u16 image[LS020_WIDTH * LS020_HEIGHT];
+	int wx0, wy0, wx1, wy1;
+	int cx, cy;
+	bool window_valid;
+	bool color8;
+	unsigned long errors;
+	const char *error;
+};
+
+static inline void ls020_model_error(struct ls020_model *m, const char *msg)
+{
+	m->errors++;
+	m->error = msg;
+}
+
+static inline bool ls020_model_decode_window(struct ls020_model *m)
+{
+	const u8 *r = m->regs;
+	int o, x0, y0, x1, y1, cx, cy;
+	u8 rot[LS020_ROTATION_CMD_LEN];
+	
+	for (o = 0; o < 4; o++) {
+		ls020_rotation_cmds(rot, o);
+		if (r[0x01] == rot[3] && r[0x05] == rot[5])
+			break;
+	}
+	if (o == 4) {
+		ls020_model_error(m, "pixel data before a rotation was selected");
+		return false;
+	}
+	if (o & 1) {
+		ls020_model_error(m, "pixel data in an orientation that is not modelled");
+		return false;
+	}
+	
+	/* Row registers span 0..0x83 and column registers 0..0xAF, as set up by init */
+	if (r[0x08] >= LS020_HEIGHT || r[0x09] >= LS020_HEIGHT || r[0x06] >= LS020_HEIGHT ||
+	    r[0x0A] >= LS020_WIDTH || r[0x0B] >= LS020_WIDTH || r[0x07] >= LS020_WIDTH) {
+		ls020_model_error(m, "window register beyond the panel's address range");
+		return false;
+	}
+	
+	y0 = r[0x08];
+	y1 = r[0x09];
+	x0 = r[0x0A];
+	x1 = r[0x0B];
+	cy = r[0x06];
+	cx = r[0x07];
+	
+	/* Orientation 0 runs x backwards, 2 runs y backwards */
+	if (o == 0) {
+		x0 = (LS020_WIDTH - 1) - x0;
+		x1 = (LS020_WIDTH - 1) - x1;
+		cx = (LS020_WIDTH - 1) - cx;
+	} else {
+		y0 = (LS020_HEIGHT - 1) - y0;
+		y1 = (LS020_HEIGHT - 1) - y1;
+		cy = (LS020_HEIGHT - 1) - cy;
+	}
+	
+	if (x0 < 0 || y0 < 0 || x1 >= LS020_WIDTH || y1 >= LS020_HEIGHT ||
+	    x0 > x1 || y0 > y1) {
+		ls020_model_error(m, "window outside the logical frame");
+		return false;
+	}
+	if (cx != x0 || cy != y0) {
+		ls020_model_error(m, "start address is not the window origin");
+		return false;
+	}
+	
+	m->wx0 = x0;
+	m->wy0 = y0;
+	m->wx1 = x1;
+	m->wy1 = y1;
+	m->cx = x0;
+	m->cy = y0;
+	return true;
+}
+
+static inline void ls020_model_cmd(struct ls020_model *m, const u8 *cmd, size_t len)
+{
+	size_t i;
+	
+	if (len & 1)
+		ls020_model_error(m, "odd number of command bytes");
+	
+	for (i = 0; i + 1 < len; i += 2) {
+		if (cmd[i] == 0xEF) {
+			m->bank = cmd[i + 1];
+			continue;
+		}
+		if (m->bank == 0x00 && cmd[i] == 0xE8)
+			m->color8 = !cmd[i + 1];
+		if (m->bank != 0x90)
+			continue;
+		m->regs[cmd[i]] = cmd[i + 1];
+		if (cmd[i] >= 0x06 && cmd[i] <= 0x0B)
+			m->window_valid = false;
+	}
+}
+
+/*
+ * Pixel data is big-endian on the wire either way: 8-bit transfers carry
+ * pre-swapped bytes, 16-bit words are shifted out MSB first.
+ */
+static inline void ls020_model_data(struct ls020_model *m, const void *buf, size_t len,
+				    bool bpw16)
+{
+	const u8 *b = buf;
+	const u16 *w = buf;
+	size_t i;
+	
+	if (!m->window_valid) {
+		if (!ls020_model_decode_window(m))
+			return;
+		m->window_valid = true;
+	}
+	
+	for (i = 0; i < (m->color8 ? len : len / 2); i++) {
+		u16 *pixel = &m->image[m->cy * LS020_WIDTH + m->cx];
+		
+		if (m->color8)
+			*pixel = b[i];
+		else
+			*pixel = bpw16 ? w[i] : (b[2 * i] << 8) | b[2 * i + 1];
+		if (++m->cx > m->wx1) {
+			m->cx = m->wx0;
+			if (++m->cy > m->wy1)
+				m->cy = m->wy0;
+		}
+	}
+}
+
+#endif /* _LS020_CORE_H */
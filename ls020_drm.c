@@ -0,0 +1,494 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DRM driver for the Siemens S65 LS020 TFT LCD
+ *
+ * Atomic modesetting on top of the simple display pipe with shadow-buffered
+ * planes. Only the damage clips of each commit are sent to the panel. The
+ * panel sequences are shared with the fbdev driver through ls020_core.h.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/spi/spi.h>
+#include <linux/gpio/consumer.h>
+#include <linux/delay.h>
+#include <linux/of.h>
+#include <linux/slab.h>
+
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_connector.h>
+#include <drm/drm_damage_helper.h>
+#include <drm/drm_drv.h>
+#include <drm/drm_fourcc.h>
+#include <drm/drm_framebuffer.h>
+#include <drm/drm_gem_atomic_helper.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_gem_shmem_helper.h>
+#include <drm/drm_managed.h>
+#include <drm/drm_modes.h>
+#include <drm/drm_modeset_helper.h>
+#include <drm/drm_modeset_helper_vtables.h>
+#include <drm/drm_probe_helper.h>
+#include <drm/drm_rect.h>
+#include <drm/drm_simple_kms_helper.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+#include <drm/clients/drm_client_setup.h>
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+#include <drm/drm_client_setup.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+#include <drm/drm_fbdev_shmem.h>
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+#include <drm/drm_fbdev_generic.h>
+#else
+#include <drm/drm_fb_helper.h>
+#endif
+
+#include "ls020_core.h"
+
+#define DRIVER_NAME "ls020_drm"
+
+#define LS020_CMD 1
+#define LS020_DATA 0
+#define LS020_DRM_CMDBUF_SIZE 64
+
+static int rotation = 0;
+module_param(rotation, int, 0444);
+MODULE_PARM_DESC(rotation, "Display rotation: 0=0°, 1=90°, 2=180°, 3=270° (default: 0)");
+
+struct ls020_drm {
+	struct drm_device drm;
+	struct drm_simple_display_pipe pipe;
+	struct drm_connector connector;
+
+	struct spi_device *spi;
+	struct gpio_desc *rst_gpio;
+	struct gpio_desc *rs_gpio;
+
+	u8 orientation;
+	bool pixel_bpw16;
+
+	/* Register pairs are copied here so spi_write() never sees the stack */
+	u8 *cmd_buf;
+	/* Packed pixels of one damage clip, sent in max_xfer sized pieces */
+	u8 *tx_buf;
+	size_t max_xfer;
+	u16 row_buf[LS020_WIDTH];
+};
+
+static inline struct ls020_drm *to_ls020_drm(struct drm_device *drm)
+{
+	return container_of(drm, struct ls020_drm, drm);
+}
+
+static const struct drm_display_mode ls020_drm_mode = {
+	DRM_SIMPLE_MODE(LS020_WIDTH, LS020_HEIGHT, 35, 26),
+};
+
+static const u32 ls020_drm_formats[] = {
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_XRGB8888,
+};
+
+/*
+ * Callers pass stack arrays and the const init tables, neither of which is
+ * DMA-safe, so the bytes go out through cmd_buf. Its size is even, so a
+ * (reg, val) pair never straddles two writes.
+ */
+static int ls020_drm_cmd(struct ls020_drm *lcd, const u8 *cmd, size_t len)
+{
+	size_t n;
+	int ret;
+	
+	gpiod_set_value_cansleep(lcd->rs_gpio, LS020_CMD);
+	for (; len; cmd += n, len -= n) {
+		n = min_t(size_t, len, LS020_DRM_CMDBUF_SIZE);
+		memcpy(lcd->cmd_buf, cmd, n);
+		ret = spi_write(lcd->spi, lcd->cmd_buf, n);
+		if (ret) {
+			dev_err(&lcd->spi->dev, "Failed to write %zu command bytes\n", n);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/* One transfer per max_xfer bytes, as ls020_flush_submit() does in ls020_fb */
+static int ls020_drm_data(struct ls020_drm *lcd, const u8 *buf, size_t len)
+{
+	struct spi_transfer xfer = {
+		.bits_per_word = lcd->pixel_bpw16 ? 16 : 8,
+	};
+	int ret;
+	
+	gpiod_set_value_cansleep(lcd->rs_gpio, LS020_DATA);
+	for (; len; buf += xfer.len, len -= xfer.len) {
+		xfer.tx_buf = buf;
+		xfer.len = min(len, lcd->max_xfer);
+		ret = spi_sync_transfer(lcd->spi, &xfer, 1);
+		if (ret) {
+			dev_err(&lcd->spi->dev, "Failed to write %u pixel bytes\n", xfer.len);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int ls020_drm_init_display(struct ls020_drm *lcd)
+{
+	u8 cmd[LS020_ROTATION_CMD_LEN];
+	int ret;
+	
+	gpiod_set_value_cansleep(lcd->rst_gpio, 0);
+	msleep(50);
+	gpiod_set_value_cansleep(lcd->rst_gpio, 1);
+	msleep(50);
+	
+	ret = ls020_drm_cmd(lcd, ls020_init_array_0, ARRAY_SIZE(ls020_init_array_0));
+	if (ret)
+		return ret;
+	
+	msleep(7);
+	
+	ret = ls020_drm_cmd(lcd, ls020_init_array_1, ARRAY_SIZE(ls020_init_array_1));
+	if (ret)
+		return ret;
+	
+	return ls020_drm_cmd(lcd, cmd, ls020_rotation_cmds(cmd, lcd->orientation));
+}
+
+static void ls020_drm_xrgb8888_row(u16 *dst, const u32 *src, unsigned int count)
+{
+	unsigned int i;
+	
+	for (i = 0; i < count; i++) {
+		u32 pix = src[i];
+		
+		dst[i] = ((pix >> 8) & 0xF800) | ((pix >> 5) & 0x07E0) |
+			 ((pix >> 3) & 0x001F);
+	}
+}
+
+/*
+ * Sends one clip of the shadow buffer: the address window is opened around
+ * it and the packed rows follow, split to the controller's transfer limit.
+ */
+static int ls020_drm_send_clip(struct ls020_drm *lcd, struct drm_framebuffer *fb,
+			       const void *vaddr, const struct drm_rect *clip)
+{
+	unsigned int width = drm_rect_width(clip);
+	u8 cmd[LS020_WINDOW_CMD_LEN];
+	u8 *dst = lcd->tx_buf;
+	int y, ret;
+	
+	for (y = clip->y1; y < clip->y2; y++) {
+		const void *src = vaddr + y * fb->pitches[0];
+		
+		if (fb->format->format == DRM_FORMAT_XRGB8888) {
+			ls020_drm_xrgb8888_row(lcd->row_buf, (const u32 *)src + clip->x1, width);
+			ls020_pack_pixels(dst, lcd->row_buf, width, lcd->pixel_bpw16);
+		} else {
+			ls020_pack_pixels(dst, (const u16 *)src + clip->x1, width,
+					  lcd->pixel_bpw16);
+		}
+		dst += width * 2;
+	}
+	
+	ret = ls020_drm_cmd(lcd, cmd, ls020_window_cmds(cmd, lcd->orientation,
+							clip->x1, clip->y1,
+							clip->x2 - 1, clip->y2 - 1));
+	if (ret)
+		return ret;
+	
+	return ls020_drm_data(lcd, lcd->tx_buf, dst - lcd->tx_buf);
+}
+
+static void ls020_drm_fb_dirty(struct ls020_drm *lcd, struct drm_plane_state *old_state,
+			       struct drm_plane_state *state, bool full)
+{
+	struct drm_shadow_plane_state *shadow = to_drm_shadow_plane_state(state);
+	struct drm_framebuffer *fb = state->fb;
+	struct drm_atomic_helper_damage_iter iter;
+	struct drm_rect clip;
+	int idx, ret;
+	
+	if (!drm_dev_enter(&lcd->drm, &idx))
+		return;
+	
+	ret = drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE);
+	if (ret)
+		goto out_exit;
+	
+	if (full) {
+		clip.x1 = 0;
+		clip.y1 = 0;
+		clip.x2 = fb->width;
+		clip.y2 = fb->height;
+		ls020_drm_send_clip(lcd, fb, shadow->data[0].vaddr, &clip);
+		goto out_end;
+	}
+	
+	drm_atomic_helper_damage_iter_init(&iter, old_state, state);
+	drm_atomic_for_each_plane_damage(&iter, &clip) {
+		if (ls020_drm_send_clip(lcd, fb, shadow->data[0].vaddr, &clip))
+			break;
+	}
+	
+out_end:
+	drm_gem_fb_end_cpu_access(fb, DMA_FROM_DEVICE);
+out_exit:
+	drm_dev_exit(idx);
+}
+
+static enum drm_mode_status ls020_drm_pipe_mode_valid(struct drm_simple_display_pipe *pipe,
+						      const struct drm_display_mode *mode)
+{
+	if (mode->hdisplay != LS020_WIDTH || mode->vdisplay != LS020_HEIGHT)
+		return MODE_BAD;
+	return MODE_OK;
+}
+
+static void ls020_drm_pipe_enable(struct drm_simple_display_pipe *pipe,
+				  struct drm_crtc_state *crtc_state,
+				  struct drm_plane_state *plane_state)
+{
+	struct ls020_drm *lcd = to_ls020_drm(pipe->crtc.dev);
+	int idx;
+	
+	if (!drm_dev_enter(&lcd->drm, &idx))
+		return;
+	
+	if (ls020_drm_init_display(lcd)) {
+		dev_err(&lcd->spi->dev, "Display initialization failed.\n");
+		drm_dev_exit(idx);
+		return;
+	}
+	drm_dev_exit(idx);
+	
+	ls020_drm_fb_dirty(lcd, NULL, plane_state, true);
+}
+
+static void ls020_drm_pipe_disable(struct drm_simple_display_pipe *pipe)
+{
+	struct ls020_drm *lcd = to_ls020_drm(pipe->crtc.dev);
+	int idx;
+	
+	if (!drm_dev_enter(&lcd->drm, &idx))
+		return;
+	
+	ls020_drm_cmd(lcd, ls020_off_array, ARRAY_SIZE(ls020_off_array));
+	drm_dev_exit(idx);
+}
+
+static void ls020_drm_pipe_update(struct drm_simple_display_pipe *pipe,
+				  struct drm_plane_state *old_state)
+{
+	struct ls020_drm *lcd = to_ls020_drm(pipe->crtc.dev);
+	struct drm_plane_state *state = pipe->plane.state;
+	
+	if (!pipe->crtc.state->active || !state->fb)
+		return;
+	
+	ls020_drm_fb_dirty(lcd, old_state, state, false);
+}
+
+static const struct drm_simple_display_pipe_funcs ls020_drm_pipe_funcs = {
+	.mode_valid = ls020_drm_pipe_mode_valid,
+	.enable = ls020_drm_pipe_enable,
+	.disable = ls020_drm_pipe_disable,
+	.update = ls020_drm_pipe_update,
+	DRM_GEM_SIMPLE_DISPLAY_PIPE_SHADOW_PLANE_FUNCS,
+};
+
+static int ls020_drm_connector_get_modes(struct drm_connector *connector)
+{
+	return drm_connector_helper_get_modes_fixed(connector, &ls020_drm_mode);
+}
+
+static const struct drm_connector_helper_funcs ls020_drm_connector_helper_funcs = {
+	.get_modes = ls020_drm_connector_get_modes,
+};
+
+static const struct drm_connector_funcs ls020_drm_connector_funcs = {
+	.reset = drm_atomic_helper_connector_reset,
+	.fill_modes = drm_helper_probe_single_connector_modes,
+	.destroy = drm_connector_cleanup,
+	.atomic_duplicate_state = drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_connector_destroy_state,
+};
+
+static const struct drm_mode_config_funcs ls020_drm_mode_config_funcs = {
+	.fb_create = drm_gem_fb_create_with_dirty,
+	.atomic_check = drm_atomic_helper_check,
+	.atomic_commit = drm_atomic_helper_commit,
+};
+
+DEFINE_DRM_GEM_FOPS(ls020_drm_fops);
+
+static const struct drm_driver ls020_drm_driver = {
+	.driver_features = DRIVER_GEM | DRIVER_MODESET | DRIVER_ATOMIC,
+	.fops = &ls020_drm_fops,
+	DRM_GEM_SHMEM_DRIVER_OPS,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	DRM_FBDEV_SHMEM_DRIVER_OPS,
+#endif
+	.name = "ls020",
+	.desc = "Siemens S65 LS020 TFT LCD",
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 14, 0)
+	.date = "20250301",
+#endif
+	.major = 1,
+	.minor = 0,
+};
+
+static void ls020_drm_fbdev_setup(struct drm_device *drm)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	drm_client_setup_with_fourcc(drm, DRM_FORMAT_RGB565);
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
+	drm_fbdev_shmem_setup(drm, 16);
+#else
+	drm_fbdev_generic_setup(drm, 16);
+#endif
+}
+
+static int ls020_drm_probe(struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	struct ls020_drm *lcd;
+	struct drm_device *drm;
+	int retval;
+	
+	lcd = devm_drm_dev_alloc(dev, &ls020_drm_driver, struct ls020_drm, drm);
+	if (IS_ERR(lcd))
+		return PTR_ERR(lcd);
+	drm = &lcd->drm;
+	lcd->spi = spi;
+	lcd->orientation = rotation & 3;
+	
+	lcd->rst_gpio = devm_gpiod_get(dev, "ls020-reset", GPIOD_OUT_LOW);
+	if (IS_ERR(lcd->rst_gpio)) {
+		dev_err(dev, "Failed to get reset GPIO\n");
+		return PTR_ERR(lcd->rst_gpio);
+	}
+	
+	lcd->rs_gpio = devm_gpiod_get(dev, "ls020-dc", GPIOD_OUT_LOW);
+	if (IS_ERR(lcd->rs_gpio)) {
+		dev_err(dev, "Failed to get RS/DC GPIO\n");
+		return PTR_ERR(lcd->rs_gpio);
+	}
+	
+	lcd->tx_buf = devm_kmalloc(dev, LS020_FRAME_SIZE, GFP_KERNEL);
+	if (!lcd->tx_buf)
+		return -ENOMEM;
+	
+	lcd->cmd_buf = devm_kmalloc(dev, LS020_DRM_CMDBUF_SIZE, GFP_KERNEL);
+	if (!lcd->cmd_buf)
+		return -ENOMEM;
+	
+	spi->max_speed_hz = 30000000;
+	spi->mode = SPI_MODE_0;
+	spi->bits_per_word = 8;
+	retval = spi_setup(spi);
+	if (retval < 0) {
+		dev_err(dev, "SPI setup failed.\n");
+		return retval;
+	}
+	lcd->pixel_bpw16 = spi_is_bpw_supported(spi, 16);
+	/* Even, so a 16-bit word is never split between two transfers */
+	lcd->max_xfer = clamp_t(size_t, spi_max_transfer_size(spi), 2,
+				LS020_FRAME_SIZE) & ~1;
+	
+	retval = drmm_mode_config_init(drm);
+	if (retval)
+		return retval;
+	drm->mode_config.min_width = LS020_WIDTH;
+	drm->mode_config.max_width = LS020_WIDTH;
+	drm->mode_config.min_height = LS020_HEIGHT;
+	drm->mode_config.max_height = LS020_HEIGHT;
+	drm->mode_config.preferred_depth = 16;
+	drm->mode_config.funcs = &ls020_drm_mode_config_funcs;
+	
+	drm_connector_helper_add(&lcd->connector, &ls020_drm_connector_helper_funcs);
+	retval = drm_connector_init(drm, &lcd->connector, &ls020_drm_connector_funcs,
+				    DRM_MODE_CONNECTOR_SPI);
+	if (retval)
+		return retval;
+	
+	retval = drm_simple_display_pipe_init(drm, &lcd->pipe, &ls020_drm_pipe_funcs,
+					      ls020_drm_formats, ARRAY_SIZE(ls020_drm_formats),
+					      NULL, &lcd->connector);
+	if (retval)
+		return retval;
+	drm_plane_enable_fb_damage_clips(&lcd->pipe.plane);
+	
+	drm_mode_config_reset(drm);
+	
+	retval = drm_dev_register(drm, 0);
+	if (retval)
+		return retval;
+	
+	spi_set_drvdata(spi, drm);
+	ls020_drm_fbdev_setup(drm);
+	
+	dev_info(dev, "LS020 DRM device registered, rotation %d°, %d-bit SPI words\n",
+		 lcd->orientation * 90, lcd->pixel_bpw16 ? 16 : 8);
+	return 0;
+}
+
+static void ls020_drm_remove(struct spi_device *spi)
+{
+	struct drm_device *drm = spi_get_drvdata(spi);
+	
+	drm_dev_unplug(drm);
+	drm_atomic_helper_shutdown(drm);
+}
+
+static void ls020_drm_shutdown(struct spi_device *spi)
+{
+	drm_atomic_helper_shutdown(spi_get_drvdata(spi));
+}
+
+static int ls020_drm_suspend(struct device *dev)
+{
+	return drm_mode_config_helper_suspend(dev_get_drvdata(dev));
+}
+
+static int ls020_drm_resume(struct device *dev)
+{
+	return drm_mode_config_helper_resume(dev_get_drvdata(dev));
+}
+
+static DEFINE_SIMPLE_DEV_PM_OPS(ls020_drm_pm_ops, ls020_drm_suspend, ls020_drm_resume);
+
+static const struct of_device_id ls020_drm_of_match[] = {
+	{ .compatible = "siemens,ls020" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, ls020_drm_of_match);
+
+static const struct spi_device_id ls020_drm_ids[] = {
+	{ "ls020", 0 },
+	{},
+};
+MODULE_DEVICE_TABLE(spi, ls020_drm_ids);
+
+static struct spi_driver ls020_drm_spi_driver = {
+	.driver = {
+		.name = DRIVER_NAME,
+		.of_match_table = ls020_drm_of_match,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.pm = pm_sleep_ptr(&ls020_drm_pm_ops),
+	},
+	.id_table = ls020_drm_ids,
+	.probe = ls020_drm_probe,
+	.remove = ls020_drm_remove,
+	.shutdown = ls020_drm_shutdown,
+};
+module_spi_driver(ls020_drm_spi_driver);
+
+MODULE_DESCRIPTION("LS020 Siemens S65 TFT LCD DRM driver");
+MODULE_AUTHOR("Yaroslav Kashapov");
+MODULE_LICENSE("GPL v2");
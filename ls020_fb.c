@@ -9,11 +9,49 @@
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/vmalloc.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/bitmap.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/wait.h>
+#include <linux/version.h>
+#include <linux/list.h>
+#include <linux/property.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/compat.h>
+#include <linux/pm_runtime.h>
+
+#include "ls020_core.h"
+#include "ls020_ioctl.h"
+
+#define CREATE_TRACE_POINTS
+#include "ls020_trace.h"
 
 #define DRIVER_NAME "ls020_fb"
-#define LS020_WIDTH 176
-#define LS020_HEIGHT 132
 #define LS020_BPP 16
+#define LS020_NUM_TXBUF 2
+
+#define LS020_CMDBUF_SIZE 64
+/* One full damage ioctl fits, so reported rectangles are never merged */
+#define LS020_MAX_OPS LS020_DAMAGE_MAX_RECTS
+#define LS020_FILL_PIXELS LS020_WIDTH
+#define LS020_GLYPH_CACHE_SIZE 64
+#define LS020_GLYPH_MAX_HEIGHT 32
+#define LS020_FPS_MAX 120
+#define LS020_GOV_IDLE_FLUSHES 4
+#define LS020_HIST_BUCKETS 16
+#define LS020_DAMAGE_BATCH 16
+#define LS020_VSYNC_TIMEOUT HZ
 
 static int rotation = 0;
 module_param(rotation, int, 0644);
@@ -21,15 +59,125 @@ MODULE_PARM_DESC(rotation, "Display rotation: 0=0°, 1=90°, 2=180°, 3=270° (d
 
 static int fps = 60;
 module_param(fps, int, 0644);
-MODULE_PARM_DESC(fps, "Display refresh rate in FPS (default: 60, max: 120)");
+MODULE_PARM_DESC(fps, "Default refresh rate in FPS for panels without an fps property (default: 60, max: 120)");
+
+static int fps_min = 10;
+module_param(fps_min, int, 0644);
+MODULE_PARM_DESC(fps_min, "Refresh rate the governor backs off to while frames are unchanged (default: 10)");
 
 static bool partial_update = true;
 module_param(partial_update, bool, 0644);
 MODULE_PARM_DESC(partial_update, "Enable partial display updates for better performance (default: true)");
 
+static bool color8 = false;
+module_param(color8, bool, 0444);
+MODULE_PARM_DESC(color8, "Send pixels as 8-bit RGB332, halving the bytes per frame (default: false)");
+
+static bool dither = true;
+module_param(dither, bool, 0444);
+MODULE_PARM_DESC(dither, "Ordered dithering in 8-bit colour mode (default: true)");
+
+static int flush_sched = 2;
+module_param(flush_sched, int, 0444);
+MODULE_PARM_DESC(flush_sched, "Flush thread scheduling: 0=normal, 1=lowest SCHED_FIFO, 2=SCHED_FIFO (default: 2)");
+
+static int flush_nice = 0;
+module_param(flush_nice, int, 0444);
+MODULE_PARM_DESC(flush_nice, "Nice value of the flush thread with flush_sched=0 (default: 0)");
+
+static int flush_cpu = -1;
+module_param(flush_cpu, int, 0444);
+MODULE_PARM_DESC(flush_cpu, "CPU the flush threads of panels without flush-cpu are bound to, -1 for any (default: -1)");
+
+static bool test_pattern = false;
+module_param(test_pattern, bool, 0444);
+MODULE_PARM_DESC(test_pattern, "Show red, green and blue bands until the first frame is drawn (default: false)");
+
 #define LS020_CMD 1
 #define LS020_DATA 0
 
+struct ls020_fb_par;
+
+enum ls020_op_type {
+	LS020_OP_FILL,
+	LS020_OP_DAMAGE,
+	LS020_OP_RECT,		/* reported by a client, sent as is */
+};
+
+/* 2D operation already rendered into video memory, waiting to be flushed */
+struct ls020_op {
+	enum ls020_op_type type;
+	u16 x, y;
+	u16 width, height;
+	u16 color;
+};
+
+/* 8-pixel wide glyph column already expanded to RGB565 */
+struct ls020_glyph {
+	bool valid;
+	u8 height;
+	u16 fg, bg;
+	u8 bits[LS020_GLYPH_MAX_HEIGHT];
+	u16 pixels[LS020_GLYPH_MAX_HEIGHT * 8];
+};
+
+/* Reasons for the panel to be switched off; it is on while none is set */
+enum ls020_off_reason {
+	LS020_OFF_BLANK = BIT(0),
+	LS020_OFF_RUNTIME = BIT(1),
+	LS020_OFF_SUSPEND = BIT(2),
+};
+
+enum ls020_stage {
+	LS020_STAGE_DIFF,
+	LS020_STAGE_PACK,
+	LS020_STAGE_XFER,
+	LS020_NUM_STAGES,
+};
+
+/*
+ * Flush pipeline counters. Latency histograms use power-of-two buckets in
+ * microseconds: bucket 0 is below 1us, bucket n covers [2^(n-1), 2^n) us.
+ */
+struct ls020_stats {
+	u64 frames_flushed;
+	u64 frames_skipped;
+	u64 partial_updates;
+	u64 full_updates;
+	u64 full_fallbacks;
+	u64 bytes_sent;
+	u64 hist[LS020_NUM_STAGES][LS020_HIST_BUCKETS];
+	ktime_t window_start;
+	unsigned int window_frames;
+	unsigned int fps_achieved;
+};
+
+/*
+ * Whether a message ends a frame is only known once the flush is packed, so
+ * the flush thread and the completion race to see which of them ends it.
+ */
+enum ls020_tx_state {
+	LS020_TX_QUEUED,
+	LS020_TX_SENT,
+	LS020_TX_FRAME_END,
+};
+
+/*
+ * One queued SPI message. Data longer than the controller's maximum transfer
+ * size is split over several transfers of the same message.
+ */
+struct ls020_txbuf {
+	struct ls020_fb_par *par;
+	u8 *buf;
+	struct spi_transfer *xfers;
+	struct spi_message msg;
+	struct completion done;
+	size_t len;
+	bool busy;
+	atomic_t state;
+	ktime_t submitted;
+};
+
 struct ls020_fb_par {
 	struct spi_device *spi;
 	struct gpio_desc *rst_gpio;
@@ -37,79 +185,410 @@ struct ls020_fb_par {
 	struct fb_info *info;
 	u16 *videomemory;
 	u16 *shadow_buffer;
-	u8 *spi_buffer;
+	struct ls020_txbuf txbuf[LS020_NUM_TXBUF];
+	unsigned int tx_next;
+	/* Last message queued by the current flush */
+	struct ls020_txbuf *tx_last;
+	size_t max_xfer;
+	size_t chunk_bytes;
+	struct mutex update_lock;
+	u8 *cmd_buf;
+	unsigned int cmd_len;
+	int cmd_err;
+	int dc_level;
+	struct ls020_op ops[LS020_MAX_OPS];
+	unsigned int nops;
+	spinlock_t ops_lock;
+	/* Ops taken off the queue by a flush, under update_lock */
+	struct ls020_op ops_drain[LS020_MAX_OPS];
+	u16 *fill_buf;
+	struct spi_transfer *fill_xfers;
+	struct ls020_glyph *glyph_cache;
+	u16 expand[16][4];
+	u16 expand_fg, expand_bg;
+	bool expand_valid;
 	u32 pseudo_palette[16];
 	u8 orientation;
 	bool invert;
 	bool window_set;
 	bool partial_update;
-	u16 dirty_x_min, dirty_y_min;
-	u16 dirty_x_max, dirty_y_max;
-	bool dirty_pending;
-	spinlock_t dirty_lock;
+	bool pixel_bpw16;
+	bool color8;
+	bool dither;
+	bool flush_changed;
+	DECLARE_BITMAP(dirty_tiles, LS020_NUM_TILES);
+	DECLARE_BITMAP(scan_rows, LS020_HEIGHT);
+	unsigned int fps;
+	unsigned int fps_min;
+	unsigned int fps_cur;
+	unsigned int idle_flushes;
+	spinlock_t gov_lock;
+	/* Frame clock: flushes start on its ticks, fps_cur apart */
+	struct hrtimer frame_timer;
+	ktime_t frame_period;
+	ktime_t frame_last;
+	atomic_t frame_panels;
+	atomic_t frame_tick;
+	unsigned long vsync_seq;
+	wait_queue_head_t vsync_wait;
+	struct fb_deferred_io defio;
+	/* Owns the SPI device and the D/C line: all panel traffic runs on it */
+	struct kthread_worker *worker;
+	struct kthread_work init_work;
+	int init_err;
+	unsigned int off;
+	bool blanked;
+	struct kthread_work flush_work;
+	/* Pixels per row of videomemory, wider than the panel when spanned */
+	unsigned int stride;
+	unsigned int x_offset;
+	struct ls020_fb_par *span;
+	struct ls020_fb_par *span_owner;
+	bool span_secondary;
+	bool span_attached;
+	struct list_head span_node;
+	struct ls020_stats stats;
+	spinlock_t stats_lock;
+	struct dentry *debugfs;
+	atomic_t open_users;
+	bool damage_explicit;
 };
 
-static const u8 init_array_0[] = {
-	0xEF, 0x00, 0xEE, 0x04, 0x1B, 0x04, 0xFE, 0xFE,
-	0xFE, 0xFE, 0xEF, 0x90, 0x4A, 0x04, 0x7F, 0x3F,
-	0xEE, 0x04, 0x43, 0x06
-};
+static struct dentry *ls020_debugfs_root;
 
-static const u8 init_array_1[] = {
-	0xEF, 0x90, 0x09, 0x83, 0x08, 0x00, 0x0B, 0xAF,
-	0x0A, 0x00, 0x05, 0x00, 0x06, 0x00, 0x07, 0x00,
-	0xEF, 0x00, 0xEE, 0x0C, 0xEF, 0x90, 0x00, 0x80,
-	0xEF, 0xB0, 0x49, 0x02, 0xEF, 0x00, 0x7F, 0x01,
-	0xE1, 0x81, 0xE2, 0x02, 0xE2, 0x76, 0xE1, 0x83,
-	0x80, 0x01, 0xEF, 0x90, 0x00, 0x00
-};
+static LIST_HEAD(ls020_span_list);
+static DEFINE_MUTEX(ls020_span_lock);
 
-static int ls020_write_cmd(struct ls020_fb_par *par, u8 cmd)
+static void ls020_stats_latency(struct ls020_fb_par *par, enum ls020_stage stage,
+				ktime_t start)
 {
-	int ret;
-	gpiod_set_value(par->rs_gpio, LS020_CMD);
-	ret = spi_write(par->spi, &cmd, 1);
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = us > 0 ? min_t(int, fls64(us), LS020_HIST_BUCKETS - 1) : 0;
+	unsigned long flags;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	par->stats.hist[stage][bucket]++;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+}
+
+static void ls020_stats_bytes(struct ls020_fb_par *par, size_t bytes)
+{
+	unsigned long flags;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	par->stats.bytes_sent += bytes;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+}
+
+static void ls020_stats_inc(struct ls020_fb_par *par, u64 *counter)
+{
+	unsigned long flags;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	(*counter)++;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+}
+
+static void ls020_stats_frame(struct ls020_fb_par *par, bool changed)
+{
+	struct ls020_stats *st = &par->stats;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	s64 elapsed;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	
+	if (!changed) {
+		st->frames_skipped++;
+		goto out;
+	}
+	
+	st->frames_flushed++;
+	st->window_frames++;
+	elapsed = ktime_to_ns(ktime_sub(now, st->window_start));
+	if (elapsed >= NSEC_PER_SEC) {
+		st->fps_achieved = div64_u64((u64)st->window_frames * NSEC_PER_SEC, elapsed);
+		st->window_frames = 0;
+		st->window_start = now;
+	}
+out:
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+}
+
+/* A rate measured over a window that ended long ago no longer applies */
+static unsigned int ls020_stats_fps(struct ls020_fb_par *par)
+{
+	unsigned long flags;
+	unsigned int fps;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	if (ktime_ms_delta(ktime_get(), par->stats.window_start) > 2 * MSEC_PER_SEC)
+		fps = 0;
+	else
+		fps = par->stats.fps_achieved;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+	
+	return fps;
+}
+
+static void ls020_stats_reset(struct ls020_fb_par *par)
+{
+	unsigned long flags;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	memset(&par->stats, 0, sizeof(par->stats));
+	par->stats.window_start = ktime_get();
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+}
+
+static struct ls020_fb_par *ls020_gov_owner(struct ls020_fb_par *par)
+{
+	return par->span_secondary ? par->span_owner : par;
+}
+
+/*
+ * A frame is done once the last chunk of every panel is on the wire; that
+ * is the vsync FBIO_WAITFORVSYNC waits for. Usually runs from the SPI
+ * completion of that chunk.
+ */
+static void ls020_frame_done(struct ls020_fb_par *par)
+{
+	struct ls020_fb_par *owner = ls020_gov_owner(par);
+	
+	if (owner && atomic_dec_and_test(&owner->frame_panels)) {
+		WRITE_ONCE(owner->vsync_seq, owner->vsync_seq + 1);
+		wake_up_interruptible_all(&owner->vsync_wait);
+	}
+}
+
+static void ls020_flush_complete(void *context)
+{
+	struct ls020_txbuf *tx = context;
+	
+	ls020_stats_latency(tx->par, LS020_STAGE_XFER, tx->submitted);
+	trace_ls020_spi_complete(&tx->par->spi->dev, tx->len, tx->msg.status);
+	
+	if (tx->msg.status)
+		dev_err_ratelimited(&tx->par->spi->dev, "Async transfer failed: %d\n",
+				    tx->msg.status);
+	
+	/* Before complete(), so ls020_flush_wait() covers the frame end too */
+	if (atomic_xchg(&tx->state, LS020_TX_SENT) == LS020_TX_FRAME_END)
+		ls020_frame_done(tx->par);
+	complete(&tx->done);
+}
+
+static int ls020_txbuf_wait(struct ls020_txbuf *tx)
+{
+	if (!tx->busy)
+		return 0;
+	
+	wait_for_completion(&tx->done);
+	tx->busy = false;
+	return tx->msg.status;
+}
+
+/* Waits for everything queued, oldest first, and returns the first error */
+static int ls020_flush_wait(struct ls020_fb_par *par)
+{
+	int i, ret = 0;
+	
+	for (i = 0; i < LS020_NUM_TXBUF; i++) {
+		int err = ls020_txbuf_wait(&par->txbuf[(par->tx_next + i) % LS020_NUM_TXBUF]);
+		
+		if (!ret)
+			ret = err;
+	}
+	
 	return ret;
 }
 
-static int ls020_write_reg(struct ls020_fb_par *par, u8 reg, u8 val)
+/*
+ * Transfer buffers are used round-robin, so the next chunk can be packed
+ * while the previous one is still being clocked out.
+ */
+static struct ls020_txbuf *ls020_flush_get_buf(struct ls020_fb_par *par)
+{
+	struct ls020_txbuf *tx = &par->txbuf[par->tx_next];
+	
+	par->tx_next = (par->tx_next + 1) % LS020_NUM_TXBUF;
+	ls020_txbuf_wait(tx);
+	
+	return tx;
+}
+
+static void ls020_set_dc(struct ls020_fb_par *par, int level)
+{
+	if (par->dc_level == level)
+		return;
+	
+	/* The D/C line must not change under a transfer that is still queued */
+	ls020_flush_wait(par);
+	gpiod_set_value(par->rs_gpio, level);
+	par->dc_level = level;
+}
+
+/*
+ * Queues pixel data for transfer. @data is normally tx->buf, but in 16-bit
+ * word mode it may point straight into video memory.
+ */
+static int ls020_flush_submit(struct ls020_fb_par *par, struct ls020_txbuf *tx,
+			      const void *data, size_t len)
 {
+	struct spi_transfer *xfer = tx->xfers;
+	size_t off, n;
 	int ret;
 	
-	gpiod_set_value(par->rs_gpio, LS020_CMD);
-	ret = spi_write(par->spi, &reg, 1);
+	spi_message_init(&tx->msg);
+	for (off = 0; off < len; off += n, xfer++) {
+		n = min(len - off, par->max_xfer);
+		memset(xfer, 0, sizeof(*xfer));
+		xfer->tx_buf = (const u8 *)data + off;
+		xfer->len = n;
+		if (par->pixel_bpw16)
+			xfer->bits_per_word = 16;
+		spi_message_add_tail(xfer, &tx->msg);
+	}
+	tx->len = len;
+	tx->msg.complete = ls020_flush_complete;
+	tx->msg.context = tx;
+	
+	ls020_set_dc(par, LS020_DATA);
+	reinit_completion(&tx->done);
+	atomic_set(&tx->state, LS020_TX_QUEUED);
+	tx->submitted = ktime_get();
+	ret = spi_async(par->spi, &tx->msg);
+	trace_ls020_spi_submit(&par->spi->dev, len, ret);
 	if (ret) {
-		dev_err(&par->spi->dev, "Failed to write reg 0x%02X\n", reg);
+		dev_err(&par->spi->dev, "Failed to queue async transfer: %d\n", ret);
 		return ret;
 	}
 	
-	ret = spi_write(par->spi, &val, 1);
-	if (ret) {
-		dev_err(&par->spi->dev, "Failed to write val 0x%02X to reg 0x%02X\n", val, reg);
-	} else {
-		dev_dbg(&par->spi->dev, "REG: 0x%02X = 0x%02X\n", reg, val);
+	tx->busy = true;
+	par->tx_last = tx;
+	ls020_stats_bytes(par, len);
+	return 0;
+}
+
+/*
+ * Everything the flush path sends from is allocated here, once per panel;
+ * no update path allocates. Transfers are capped at the controller's maximum
+ * transfer size. Packed data is streamed in chunks of LS020_CHUNK_ROWS RGB565
+ * rows or one transfer, whichever is smaller, but at least one row.
+ */
+static int ls020_flush_alloc(struct ls020_fb_par *par)
+{
+	int i;
+	
+	par->max_xfer = clamp_t(size_t, spi_max_transfer_size(par->spi), 2, LS020_FRAME_SIZE) & ~1;
+	par->chunk_bytes = clamp_t(size_t, par->max_xfer, LS020_WIDTH * 2,
+				   LS020_CHUNK_ROWS * LS020_WIDTH * 2);
+	
+	for (i = 0; i < LS020_NUM_TXBUF; i++) {
+		struct ls020_txbuf *tx = &par->txbuf[i];
+		
+		tx->buf = kmalloc(par->chunk_bytes, GFP_KERNEL);
+		tx->xfers = kcalloc(DIV_ROUND_UP(LS020_FRAME_SIZE, par->max_xfer),
+				    sizeof(*tx->xfers), GFP_KERNEL);
+		if (!tx->buf || !tx->xfers)
+			return -ENOMEM;
+		tx->par = par;
+		tx->busy = false;
+		init_completion(&tx->done);
 	}
 	
-	return ret;
+	par->cmd_buf = kmalloc(LS020_CMDBUF_SIZE, GFP_KERNEL);
+	if (!par->cmd_buf)
+		return -ENOMEM;
+	
+	/* Sized for a full-screen fill in RGB565, whose runs are the shortest */
+	par->fill_buf = kmalloc_array(LS020_FILL_PIXELS, sizeof(u16), GFP_KERNEL);
+	par->fill_xfers = kcalloc(DIV_ROUND_UP(LS020_WIDTH * LS020_HEIGHT,
+					       min_t(size_t, LS020_FILL_PIXELS, par->max_xfer / 2)),
+				  sizeof(*par->fill_xfers), GFP_KERNEL);
+	if (!par->fill_buf || !par->fill_xfers)
+		return -ENOMEM;
+	
+	par->cmd_len = 0;
+	par->cmd_err = 0;
+	par->dc_level = -1;
+	par->tx_next = 0;
+	return 0;
 }
 
-static int ls020_write_data16(struct ls020_fb_par *par, u16 data)
+static void ls020_flush_free(struct ls020_fb_par *par)
 {
-	u8 buf[2];
-	int ret;
+	int i;
+	
+	ls020_flush_wait(par);
+	for (i = 0; i < LS020_NUM_TXBUF; i++) {
+		kfree(par->txbuf[i].buf);
+		par->txbuf[i].buf = NULL;
+		kfree(par->txbuf[i].xfers);
+		par->txbuf[i].xfers = NULL;
+	}
+	kfree(par->cmd_buf);
+	par->cmd_buf = NULL;
+	kfree(par->fill_buf);
+	par->fill_buf = NULL;
+	kfree(par->fill_xfers);
+	par->fill_xfers = NULL;
+}
+
+/*
+ * Command bytes are gathered in cmd_buf and sent as one transfer by
+ * ls020_cmd_flush(), so a window setup or init sequence costs a single SPI
+ * message instead of one per byte.
+ */
+static int ls020_cmd_flush(struct ls020_fb_par *par)
+{
+	int ret = par->cmd_err;
 	
-	buf[0] = data >> 8;
-	buf[1] = data & 0xFF;
+	par->cmd_err = 0;
+	if (!par->cmd_len)
+		return ret;
 	
-	gpiod_set_value(par->rs_gpio, LS020_DATA);
-	dev_dbg(&par->spi->dev, "RS=LOW for DATA: 0x%04X\n", data);
-	ret = spi_write(par->spi, buf, 2);
+	ls020_set_dc(par, LS020_CMD);
+	if (!ret)
+		ret = spi_write(par->spi, par->cmd_buf, par->cmd_len);
+	trace_ls020_cmd_write(&par->spi->dev, par->cmd_len, ret);
 	if (ret) {
-		dev_err(&par->spi->dev, "Failed to write data16 0x%04X\n", data);
+		dev_err(&par->spi->dev, "Failed to write %u command bytes\n", par->cmd_len);
+	} else {
+		dev_dbg(&par->spi->dev, "CMD: %*ph\n", par->cmd_len, par->cmd_buf);
+		ls020_stats_bytes(par, par->cmd_len);
 	}
+	
+	par->cmd_len = 0;
 	return ret;
 }
 
+static void ls020_cmd_bytes(struct ls020_fb_par *par, const u8 *bytes, size_t len)
+{
+	while (len) {
+		size_t n = min_t(size_t, len, LS020_CMDBUF_SIZE - par->cmd_len);
+		
+		memcpy(par->cmd_buf + par->cmd_len, bytes, n);
+		par->cmd_len += n;
+		bytes += n;
+		len -= n;
+		
+		if (par->cmd_len == LS020_CMDBUF_SIZE) {
+			int ret = ls020_cmd_flush(par);
+			
+			if (ret)
+				par->cmd_err = ret;
+		}
+	}
+}
+
+static void ls020_cmd_reg(struct ls020_fb_par *par, u8 reg, u8 val)
+{
+	u8 cmd[2] = { reg, val };
+	
+	ls020_cmd_bytes(par, cmd, sizeof(cmd));
+}
+
 static int ls020_reset(struct ls020_fb_par *par)
 {
 	dev_dbg(&par->spi->dev, "Resetting display...\n");
@@ -125,7 +604,7 @@ static int ls020_reset(struct ls020_fb_par *par)
 
 static int ls020_init_display(struct ls020_fb_par *par)
 {
-	int i, ret;
+	int ret;
 	
 	dev_info(&par->spi->dev, "Initializing display...\n");
 
@@ -134,17 +613,24 @@ static int ls020_init_display(struct ls020_fb_par *par)
 		return ret;
 	
 	dev_info(&par->spi->dev, "Sending init sequence 0\n");
-	for (i = 0; i < ARRAY_SIZE(init_array_0); i++) {
-		ret = ls020_write_cmd(par, init_array_0[i]);
-		if (ret)
-			return ret;
-	}
+	ls020_cmd_bytes(par, ls020_init_array_0, ARRAY_SIZE(ls020_init_array_0));
+	ret = ls020_cmd_flush(par);
+	if (ret)
+		return ret;
 	
 	msleep(7);
 	
 	dev_info(&par->spi->dev, "Sending init sequence 1\n");
-	for (i = 0; i < ARRAY_SIZE(init_array_1); i++) {
-		ret = ls020_write_cmd(par, init_array_1[i]);
+	ls020_cmd_bytes(par, ls020_init_array_1, ARRAY_SIZE(ls020_init_array_1));
+	ret = ls020_cmd_flush(par);
+	if (ret)
+		return ret;
+	
+	if (par->color8) {
+		u8 cmd[LS020_COLOR8_CMD_LEN];
+		
+		ls020_cmd_bytes(par, cmd, ls020_color8_cmds(cmd));
+		ret = ls020_cmd_flush(par);
 		if (ret)
 			return ret;
 	}
@@ -155,393 +641,789 @@ static int ls020_init_display(struct ls020_fb_par *par)
 
 static int ls020_set_addr_window(struct ls020_fb_par *par, u8 x0, u8 y0, u8 x1, u8 y1)
 {
-	int ret;
-	
-	ret = ls020_write_reg(par, 0xEF, 0x90);
-	if (ret)
-		return ret;
+	u8 cmd[LS020_WINDOW_CMD_LEN];
 	
-	switch (par->orientation) {
-	case 0:
-		ret = ls020_write_reg(par, 0x08, y0);
-		ret |= ls020_write_reg(par, 0x09, y1);
-		ret |= ls020_write_reg(par, 0x0A, (LS020_WIDTH - 1) - x0);
-		ret |= ls020_write_reg(par, 0x0B, (LS020_WIDTH - 1) - x1);
-		ret |= ls020_write_reg(par, 0x06, y0);
-		ret |= ls020_write_reg(par, 0x07, (LS020_WIDTH - 1) - x0);
-		break;
-	case 1:
-		ret = ls020_write_reg(par, 0x08, x0);
-		ret |= ls020_write_reg(par, 0x09, x1);
-		ret |= ls020_write_reg(par, 0x0A, y0);
-		ret |= ls020_write_reg(par, 0x0B, y1);
-		ret |= ls020_write_reg(par, 0x06, x0);
-		ret |= ls020_write_reg(par, 0x07, y0);
-		break;
-	case 2:
-		ret = ls020_write_reg(par, 0x08, (LS020_HEIGHT - 1) - y0);
-		ret |= ls020_write_reg(par, 0x09, (LS020_HEIGHT - 1) - y1);
-		ret |= ls020_write_reg(par, 0x0A, x0);
-		ret |= ls020_write_reg(par, 0x0B, x1);
-		ret |= ls020_write_reg(par, 0x06, (LS020_HEIGHT - 1) - y0);
-		ret |= ls020_write_reg(par, 0x07, x0);
-		break;
-	case 3:
-		ret = ls020_write_reg(par, 0x08, (LS020_HEIGHT - 1) - x0);
-		ret |= ls020_write_reg(par, 0x09, (LS020_HEIGHT - 1) - x1);
-		ret |= ls020_write_reg(par, 0x0A, (LS020_WIDTH - 1) - y0);
-		ret |= ls020_write_reg(par, 0x0B, (LS020_WIDTH - 1) - y1);
-		ret |= ls020_write_reg(par, 0x06, (LS020_HEIGHT - 1) - x0);
-		ret |= ls020_write_reg(par, 0x07, (LS020_WIDTH - 1) - y0);
-		break;
-	}
+	trace_ls020_window(&par->spi->dev, x0, y0, x1, y1);
 	
-	return ret;
+	ls020_cmd_bytes(par, cmd, ls020_window_cmds(cmd, par->orientation, x0, y0, x1, y1));
+	return ls020_cmd_flush(par);
 }
 
 static void ls020_mark_dirty_region(struct ls020_fb_par *par, u16 x, u16 y, u16 width, u16 height)
 {
-	unsigned long flags;
+	int tx, ty, tx0, tx1, ty0, ty1;
 	
-	if (!par->partial_update)
+	if (!par->partial_update || !width || !height)
+		return;
+	if (x >= LS020_WIDTH || y >= LS020_HEIGHT)
 		return;
-		
-	spin_lock_irqsave(&par->dirty_lock, flags);
-	
-	if (!par->dirty_pending) {
-		par->dirty_x_min = x;
-		par->dirty_y_min = y;
-		par->dirty_x_max = x + width - 1;
-		par->dirty_y_max = y + height - 1;
-		par->dirty_pending = true;
-	} else {
-		if (x < par->dirty_x_min)
-			par->dirty_x_min = x;
-		if (y < par->dirty_y_min)
-			par->dirty_y_min = y;
-		if (x + width - 1 > par->dirty_x_max)
-			par->dirty_x_max = x + width - 1;
-		if (y + height - 1 > par->dirty_y_max)
-			par->dirty_y_max = y + height - 1;
-	}
 	
-	par->dirty_x_min = min_t(u16, par->dirty_x_min, LS020_WIDTH - 1);
-	par->dirty_y_min = min_t(u16, par->dirty_y_min, LS020_HEIGHT - 1);
-	par->dirty_x_max = min_t(u16, par->dirty_x_max, LS020_WIDTH - 1);
-	par->dirty_y_max = min_t(u16, par->dirty_y_max, LS020_HEIGHT - 1);
+	tx0 = x / LS020_TILE_SIZE;
+	ty0 = y / LS020_TILE_SIZE;
+	tx1 = min_t(u16, x + width - 1, LS020_WIDTH - 1) / LS020_TILE_SIZE;
+	ty1 = min_t(u16, y + height - 1, LS020_HEIGHT - 1) / LS020_TILE_SIZE;
 	
-	spin_unlock_irqrestore(&par->dirty_lock, flags);
+	for (ty = ty0; ty <= ty1; ty++)
+		for (tx = tx0; tx <= tx1; tx++)
+			set_bit(ty * LS020_TILES_X + tx, par->dirty_tiles);
 }
 
-static bool ls020_detect_changes(struct ls020_fb_par *par)
+static void ls020_take_bitmap(unsigned long *dst, unsigned long *src, unsigned int nbits)
 {
-	u16 *vmem = par->videomemory;
-	u16 *shadow = par->shadow_buffer;
-	bool found_change = false;
-	int x, y;
+	int i;
 	
-	if (!par->partial_update || !shadow)
+	for (i = 0; i < BITS_TO_LONGS(nbits); i++)
+		dst[i] = xchg(&src[i], 0);
+}
+
+/*
+ * Marks the tiles that differ from what the panel currently shows, looking
+ * only at the scanlines in @rows. The shadow buffer itself is only brought
+ * up to date by the flush that sends a tile.
+ */
+static bool ls020_detect_changes(struct ls020_fb_par *par, const unsigned long *rows)
+{
+	if (!par->partial_update || !par->shadow_buffer)
 		return true;
 	
-	par->dirty_pending = false;
+	trace_ls020_detect_start(&par->spi->dev, bitmap_weight(rows, LS020_HEIGHT));
+	
+	ls020_diff_rows(par->videomemory, par->stride, par->shadow_buffer, rows,
+			par->dirty_tiles);
+	
+	if (trace_ls020_detect_end_enabled()) {
+		unsigned int ntiles = bitmap_weight(par->dirty_tiles, LS020_NUM_TILES);
+		struct ls020_rect r, px = { 0 };
+		
+		if (ntiles) {
+			ls020_tiles_bbox(par->dirty_tiles, &r);
+			ls020_tile_rect_pixels(&r, &px);
+		}
+		trace_ls020_detect_end(&par->spi->dev, ntiles, px.x0, px.y0, px.x1, px.y1);
+	}
 	
-	for (y = 0; y < LS020_HEIGHT; y++) {
-		for (x = 0; x < LS020_WIDTH; x++) {
-			int offset = y * LS020_WIDTH + x;
+	return !bitmap_empty(par->dirty_tiles, LS020_NUM_TILES);
+}
+
+static size_t ls020_pixel_bytes(struct ls020_fb_par *par, size_t pixels)
+{
+	return par->color8 ? pixels : pixels * 2;
+}
+
+/* Packs @count pixels of the row starting at logical (@x, @y) */
+static void ls020_pack_row(struct ls020_fb_par *par, u8 *dst, const u16 *src, int count,
+			   int x, int y)
+{
+	if (par->color8)
+		ls020_pack_pixels8(dst, src, count, x, y, par->dither);
+	else
+		ls020_pack_pixels(dst, src, count, par->pixel_bpw16);
+}
+
+/*
+ * Packs and queues rows @y0..@y1 of columns @x0..@x1 one chunk at a time.
+ * Each chunk is queued as soon as it is packed, so the panel already
+ * receives the first rows while the next chunk is packed into the other
+ * transfer buffer.
+ */
+static int ls020_stream_rows(struct ls020_fb_par *par, int x0, int y0, int x1, int y1)
+{
+	const u16 *vmem = par->videomemory;
+	int width = x1 - x0 + 1;
+	int rows = max_t(int, par->chunk_bytes / ls020_pixel_bytes(par, width), 1);
+	bool shadow = par->shadow_buffer && par->partial_update;
+	struct ls020_txbuf *tx;
+	int y, i, n, ret;
+	ktime_t start;
+	
+	for (y = y0; y <= y1; y += n) {
+		n = min(rows, y1 - y + 1);
+		tx = ls020_flush_get_buf(par);
+		start = ktime_get();
+		for (i = 0; i < n; i++) {
+			const u16 *src = vmem + (y + i) * par->stride + x0;
 			
-			if (vmem[offset] != shadow[offset]) {
-				if (!found_change) {
-					par->dirty_x_min = x;
-					par->dirty_y_min = y;
-					par->dirty_x_max = x;
-					par->dirty_y_max = y;
-					found_change = true;
-				} else {
-					if (x < par->dirty_x_min) par->dirty_x_min = x;
-					if (x > par->dirty_x_max) par->dirty_x_max = x;
-					if (y < par->dirty_y_min) par->dirty_y_min = y;
-					if (y > par->dirty_y_max) par->dirty_y_max = y;
-				}
-				
-				shadow[offset] = vmem[offset];
-			}
+			if (shadow)
+				memcpy(par->shadow_buffer + (y + i) * LS020_WIDTH + x0, src,
+				       width * 2);
+			ls020_pack_row(par, tx->buf + ls020_pixel_bytes(par, i * width), src,
+				       width, x0, y + i);
 		}
+		ls020_stats_latency(par, LS020_STAGE_PACK, start);
+		
+		ret = ls020_flush_submit(par, tx, tx->buf, ls020_pixel_bytes(par, n * width));
+		if (ret)
+			return ret;
 	}
 	
-	par->dirty_pending = found_change;
-	return found_change;
+	return 0;
 }
 
-static int ls020_update_display_partial(struct ls020_fb_par *par)
+/* Opens the address window on a pixel rectangle and sends it from video memory */
+static int ls020_send_rect(struct ls020_fb_par *par, u8 x0, u8 y0, u8 x1, u8 y1)
 {
 	u16 *vmem = par->videomemory;
-	u8 *data_buf;
-	int ret, i, x, y;
-	u16 width, height;
+	struct ls020_txbuf *tx;
+	int ret, width;
 	size_t buf_size;
-	bool need_free = false;
-	
-	if (!par->dirty_pending)
-		return 0;
+	ktime_t start;
 	
-	width = par->dirty_x_max - par->dirty_x_min + 1;
-	height = par->dirty_y_max - par->dirty_y_min + 1;
-	buf_size = width * height * 2;
+	width = x1 - x0 + 1;
+	buf_size = ls020_pixel_bytes(par, width * (y1 - y0 + 1));
 	
-	if (buf_size > (LS020_WIDTH * LS020_HEIGHT * 2) / 4) {
-		par->dirty_x_min = 0;
-		par->dirty_y_min = 0;
-		par->dirty_x_max = LS020_WIDTH - 1;
-		par->dirty_y_max = LS020_HEIGHT - 1;
-		width = LS020_WIDTH;
-		height = LS020_HEIGHT;
-		buf_size = LS020_WIDTH * LS020_HEIGHT * 2;
-	}
-	
-	if (par->spi_buffer && buf_size <= LS020_WIDTH * LS020_HEIGHT * 2) {
-		data_buf = par->spi_buffer;
-	} else {
-		data_buf = kmalloc(buf_size, GFP_ATOMIC);
-		if (!data_buf) {
-			dev_warn(&par->spi->dev, "Failed to allocate partial update buffer\n");
-			return -ENOMEM;
-		}
-		need_free = true;
-	}
+	trace_ls020_update_partial(&par->spi->dev, x0, y0, x1, y1);
 	
-	ret = ls020_set_addr_window(par, par->dirty_x_min, par->dirty_y_min,
-				    par->dirty_x_max, par->dirty_y_max);
-	if (ret) {
-		if (need_free) kfree(data_buf);
+	ret = ls020_set_addr_window(par, x0, y0, x1, y1);
+	if (ret)
 		return ret;
-	}
 	
-	i = 0;
-	for (y = par->dirty_y_min; y <= par->dirty_y_max; y++) {
-		for (x = par->dirty_x_min; x <= par->dirty_x_max; x++) {
-			u16 pixel = vmem[y * LS020_WIDTH + x];
-			data_buf[i++] = pixel >> 8;
-			data_buf[i++] = pixel & 0xFF;
-		}
+	if (par->pixel_bpw16 && width == LS020_WIDTH && par->stride == LS020_WIDTH) {
+		/* Full-width bands are contiguous in video memory */
+		const u16 *data = vmem + y0 * LS020_WIDTH;
+		
+		tx = ls020_flush_get_buf(par);
+		start = ktime_get();
+		memcpy(par->shadow_buffer + y0 * LS020_WIDTH, data, buf_size);
+		ls020_stats_latency(par, LS020_STAGE_PACK, start);
+		ret = ls020_flush_submit(par, tx, data, buf_size);
+	} else {
+		ret = ls020_stream_rows(par, x0, y0, x1, y1);
 	}
-	
-	gpiod_set_value(par->rs_gpio, LS020_DATA);
-	ret = spi_write(par->spi, data_buf, buf_size);
-	
-	if (need_free)
-		kfree(data_buf);
 
-	par->dirty_pending = false;
 	par->window_set = false;
 	
 	dev_dbg(&par->spi->dev, "Partial update: (%d,%d) to (%d,%d) [%dx%d]\n",
-		par->dirty_x_min, par->dirty_y_min, par->dirty_x_max, par->dirty_y_max,
-		width, height);
+		x0, y0, x1, y1, x1 - x0 + 1, y1 - y0 + 1);
 	
 	return ret;
 }
 
+static int ls020_update_display_partial(struct ls020_fb_par *par, const struct ls020_rect *tr)
+{
+	struct ls020_rect px;
+	
+	ls020_tile_rect_pixels(tr, &px);
+	return ls020_send_rect(par, px.x0, px.y0, px.x1, px.y1);
+}
+
 static int ls020_set_rotation(struct ls020_fb_par *par, u8 rotation)
 {
-	u8 val01, val05;
-	int ret;
+	u8 cmd[LS020_ROTATION_CMD_LEN];
 	
 	par->orientation = rotation & 3;
+	ls020_cmd_bytes(par, cmd, ls020_rotation_cmds(cmd, par->orientation));
 	
-	switch (par->orientation) {
-	case 1:
-		val01 = 0x00;
-		val05 = 0x00;
-		break;
-	case 2:
-		val01 = 0x80;
-		val05 = 0x04;
-		break;
-	case 3:
-		val01 = 0xC0;
-		val05 = 0x00;
-		break;
-	default:
-		val01 = 0x40;
-		val05 = 0x04;
-		break;
+	return ls020_cmd_flush(par);
+}
+
+/*
+ * Solid fills are sent as one message whose transfers all point at the same
+ * short run of the fill colour, so a large rectangle needs no buffer of its
+ * own size. The run is cut short where the controller's maximum transfer
+ * size is smaller.
+ */
+static int ls020_send_fill(struct ls020_fb_par *par, const struct ls020_op *op)
+{
+	struct spi_message msg;
+	size_t remaining = op->width * op->height;
+	size_t run = min_t(size_t, LS020_FILL_PIXELS,
+			   par->max_xfer / ls020_pixel_bytes(par, 1));
+	u16 pixel = par->pixel_bpw16 ? op->color : (__force u16)cpu_to_be16(op->color);
+	int ret, i, n = 0, y;
+	
+	if (par->color8)
+		memset(par->fill_buf, ls020_rgb332(op->color, 0, 0, false), run);
+	else
+		for (i = 0; i < min_t(int, remaining, run); i++)
+			par->fill_buf[i] = pixel;
+	
+	spi_message_init(&msg);
+	while (remaining) {
+		struct spi_transfer *xfer = &par->fill_xfers[n++];
+		size_t count = min(remaining, run);
+		
+		memset(xfer, 0, sizeof(*xfer));
+		xfer->tx_buf = par->fill_buf;
+		xfer->len = ls020_pixel_bytes(par, count);
+		if (par->pixel_bpw16)
+			xfer->bits_per_word = 16;
+		spi_message_add_tail(xfer, &msg);
+		remaining -= count;
 	}
 	
-	ret = ls020_write_reg(par, 0xEF, 0x90);
-	ret |= ls020_write_reg(par, 0x01, val01);
-	ret |= ls020_write_reg(par, 0x05, val05);
+	ret = ls020_set_addr_window(par, op->x, op->y, op->x + op->width - 1,
+				    op->y + op->height - 1);
+	if (ret)
+		return ret;
 	
-	return ret;
+	ls020_set_dc(par, LS020_DATA);
+	ret = spi_sync(par->spi, &msg);
+	par->window_set = false;
+	if (ret)
+		return ret;
+	ls020_stats_bytes(par, ls020_pixel_bytes(par, op->width * op->height));
+	
+	for (y = op->y; y < op->y + op->height; y++)
+		for (i = op->x; i < op->x + op->width; i++)
+			par->shadow_buffer[y * LS020_WIDTH + i] = op->color;
+	
+	return 0;
 }
 
-static void ls020_fillrect(struct fb_info *info, const struct fb_fillrect *rect)
+static void ls020_panel_queue_op(struct ls020_fb_par *par, enum ls020_op_type type,
+				 u16 x, u16 y, u16 width, u16 height)
 {
-	struct ls020_fb_par *par = info->par;
-	u16 color = rect->color;
-	u32 x, y;
-	int ret;
-
-	ls020_mark_dirty_region(par, rect->dx, rect->dy, rect->width, rect->height);
+	unsigned long flags;
+	struct ls020_op *op;
 	
-	par->window_set = false;
+	if (!par->partial_update || !par->shadow_buffer)
+		return;
 	
-	ret = ls020_set_addr_window(par, rect->dx, rect->dy, 
-				    rect->dx + rect->width - 1, 
-				    rect->dy + rect->height - 1);
-	if (ret)
+	spin_lock_irqsave(&par->ops_lock, flags);
+	if (par->nops < LS020_MAX_OPS) {
+		op = &par->ops[par->nops++];
+		op->type = type;
+		op->x = x;
+		op->y = y;
+		op->width = width;
+		op->height = height;
+		op->color = par->videomemory[y * par->stride + x];
+	} else {
+		ls020_mark_dirty_region(par, x, y, width, height);
+	}
+	spin_unlock_irqrestore(&par->ops_lock, flags);
+}
+
+/* Splits a framebuffer rectangle between the panels it spans */
+static void ls020_queue_op(struct fb_info *info, enum ls020_op_type type,
+			   u32 x, u32 y, u32 width, u32 height)
+{
+	struct ls020_fb_par *par;
+	
+	if (x >= info->var.xres || y >= info->var.yres || !width || !height)
 		return;
+	width = min_t(u32, width, info->var.xres - x);
+	height = min_t(u32, height, info->var.yres - y);
 	
-	if (rect->width * rect->height > 64) {
-		u8 *fill_buf;
-		size_t fill_size = rect->width * rect->height * 2;
-		u8 color_bytes[2] = { color >> 8, color & 0xFF };
+	for (par = info->par; par; par = par->span) {
+		u32 x0 = max_t(u32, x, par->x_offset);
+		u32 x1 = min_t(u32, x + width, par->x_offset + LS020_WIDTH);
 		
-		fill_buf = kmalloc(fill_size, GFP_ATOMIC);
-		if (fill_buf) {
-			for (u32 i = 0; i < rect->width * rect->height; i++) {
-				fill_buf[i * 2] = color_bytes[0];
-				fill_buf[i * 2 + 1] = color_bytes[1];
-			}
-			
-			gpiod_set_value(par->rs_gpio, LS020_DATA);
-			spi_write(par->spi, fill_buf, fill_size);
-			kfree(fill_buf);
-			
-			if (par->shadow_buffer) {
-				for (y = rect->dy; y < rect->dy + rect->height; y++) {
-					for (x = rect->dx; x < rect->dx + rect->width; x++) {
-						par->shadow_buffer[y * LS020_WIDTH + x] = color;
-					}
-				}
-			}
-			return;
-		}
+		if (x0 < x1)
+			ls020_panel_queue_op(par, type, x0 - par->x_offset, y, x1 - x0, height);
 	}
 	
-	for (y = 0; y < rect->height; y++) {
-		for (x = 0; x < rect->width; x++) {
-			ls020_write_data16(par, color);
-			if (par->shadow_buffer) {
-				par->shadow_buffer[(rect->dy + y) * LS020_WIDTH + (rect->dx + x)] = color;
-			}
-		}
-	}
+	schedule_delayed_work(&info->deferred_work, info->fbdefio->delay);
 }
 
-static void ls020_copyarea(struct fb_info *info, const struct fb_copyarea *area)
+/*
+ * Sends queued solid fills and client-reported rectangles, each with its own
+ * address window, and turns every other queued operation into tile damage.
+ * These go first: tiles are always sent from current video memory, so
+ * anything drawn over them later is still shown correctly. Dithered fills
+ * are not solid on the panel and are sent as damage as well.
+ */
+static unsigned int ls020_drain_ops(struct ls020_fb_par *par)
 {
-	cfb_copyarea(info, area);
+	struct ls020_op *ops = par->ops_drain;
+	unsigned long flags;
+	unsigned int i, nops;
+	int ret = 0;
+	
+	spin_lock_irqsave(&par->ops_lock, flags);
+	nops = par->nops;
+	memcpy(ops, par->ops, nops * sizeof(*ops));
+	par->nops = 0;
+	spin_unlock_irqrestore(&par->ops_lock, flags);
+	
+	for (i = 0; i < nops; i++) {
+		if (ops[i].type == LS020_OP_FILL && !ret && !(par->color8 && par->dither)) {
+			ret = ls020_send_fill(par, &ops[i]);
+			if (!ret)
+				continue;
+		}
+		if (ops[i].type == LS020_OP_RECT && !ret) {
+			ret = ls020_send_rect(par, ops[i].x, ops[i].y,
+					      ops[i].x + ops[i].width - 1,
+					      ops[i].y + ops[i].height - 1);
+			if (!ret)
+				continue;
+		}
+		ls020_mark_dirty_region(par, ops[i].x, ops[i].y,
+					ops[i].width, ops[i].height);
+	}
+	
+	return nops;
 }
 
-static void ls020_imageblit(struct fb_info *info, const struct fb_image *image)
+static void ls020_fillrect(struct fb_info *info, const struct fb_fillrect *rect)
 {
-	cfb_imageblit(info, image);
+	struct ls020_fb_par *par = info->par;
+	
+	trace_ls020_fillrect(&par->spi->dev, rect);
+	sys_fillrect(info, rect);
+	ls020_queue_op(info, rect->rop == ROP_COPY ? LS020_OP_FILL : LS020_OP_DAMAGE,
+		       rect->dx, rect->dy, rect->width, rect->height);
 }
 
-static int ls020_update_display_slow(struct ls020_fb_par *par)
+static void ls020_copyarea(struct fb_info *info, const struct fb_copyarea *area)
 {
-	u16 *vmem = par->videomemory;
-	int ret, x, y;
+	sys_copyarea(info, area);
+	ls020_queue_op(info, LS020_OP_DAMAGE, area->dx, area->dy,
+		       area->width, area->height);
+}
+
+static void ls020_expand_table(struct ls020_fb_par *par, u16 fg, u16 bg)
+{
+	int n, b;
 	
-	ret = ls020_set_addr_window(par, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
-	if (ret)
-		return ret;
+	if (par->expand_valid && par->expand_fg == fg && par->expand_bg == bg)
+		return;
+	
+	for (n = 0; n < 16; n++)
+		for (b = 0; b < 4; b++)
+			par->expand[n][b] = (n & (8 >> b)) ? fg : bg;
+	
+	par->expand_fg = fg;
+	par->expand_bg = bg;
+	par->expand_valid = true;
+}
 
-	for (y = 0; y < LS020_HEIGHT; y++) {
-		for (x = 0; x < LS020_WIDTH; x++) {
-			ret = ls020_write_data16(par, vmem[y * LS020_WIDTH + x]);
-			if (ret)
-				return ret;
-		}
+static inline void ls020_expand_byte(struct ls020_fb_par *par, u16 *dst, u8 bits, int count)
+{
+	int i;
+	
+	if (count == 8) {
+		memcpy(dst, par->expand[bits >> 4], sizeof(par->expand[0]));
+		memcpy(dst + 4, par->expand[bits & 0xF], sizeof(par->expand[0]));
+		return;
 	}
 	
-	return 0;
+	for (i = 0; i < count; i++)
+		dst[i] = (bits & (0x80 >> i)) ? par->expand_fg : par->expand_bg;
 }
 
-static int ls020_update_display(struct ls020_fb_par *par)
+/*
+ * fb_image carries no font or glyph index, so glyph columns are keyed by
+ * their bitmap bytes together with the colours they were expanded with.
+ */
+static const u16 *ls020_glyph_lookup(struct ls020_fb_par *par, const u8 *data,
+				     int pitch, int height)
 {
-	if (par->partial_update) {
-		if (par->shadow_buffer) {
-			if (!ls020_detect_changes(par))
-				return 0;
-		}
+	struct ls020_glyph *g;
+	u8 bits[LS020_GLYPH_MAX_HEIGHT];
+	int r;
+	
+	for (r = 0; r < height; r++)
+		bits[r] = data[r * pitch];
+	
+	g = &par->glyph_cache[jhash(bits, height, par->expand_fg | par->expand_bg << 16) %
+			      LS020_GLYPH_CACHE_SIZE];
+	if (g->valid && g->height == height && g->fg == par->expand_fg &&
+	    g->bg == par->expand_bg && !memcmp(g->bits, bits, height))
+		return g->pixels;
+	
+	for (r = 0; r < height; r++)
+		ls020_expand_byte(par, g->pixels + r * 8, bits[r], 8);
+	memcpy(g->bits, bits, height);
+	g->height = height;
+	g->fg = par->expand_fg;
+	g->bg = par->expand_bg;
+	g->valid = true;
+	
+	return g->pixels;
+}
+
+static void ls020_imageblit(struct fb_info *info, const struct fb_image *image)
+{
+	struct ls020_fb_par *par = info->par;
+	const u8 *data = (const u8 *)image->data;
+	u32 *palette = info->pseudo_palette;
+	int stride = info->fix.line_length / 2;
+	int pitch, c, r;
+	u16 *dst;
+	
+	trace_ls020_imageblit(&par->spi->dev, image);
+	
+	if (image->depth != 1 || !par->glyph_cache ||
+	    image->height > LS020_GLYPH_MAX_HEIGHT ||
+	    image->dx + image->width > info->var.xres ||
+	    image->dy + image->height > info->var.yres) {
+		sys_imageblit(info, image);
+		goto queue;
+	}
+	
+	ls020_expand_table(par, palette[image->fg_color], palette[image->bg_color]);
+	
+	pitch = DIV_ROUND_UP(image->width, 8);
+	dst = par->videomemory + image->dy * stride + image->dx;
+	
+	for (c = 0; c < pitch; c++) {
+		int count = min_t(int, 8, image->width - c * 8);
 		
-		if (par->dirty_pending) {
-			return ls020_update_display_partial(par);
+		if (count == 8) {
+			const u16 *pix = ls020_glyph_lookup(par, data + c, pitch, image->height);
+			
+			for (r = 0; r < image->height; r++)
+				memcpy(dst + r * stride + c * 8, pix + r * 8, 8 * sizeof(u16));
+		} else {
+			for (r = 0; r < image->height; r++)
+				ls020_expand_byte(par, dst + r * stride + c * 8,
+						  data[r * pitch + c], count);
 		}
 	}
 	
+queue:
+	ls020_queue_op(info, LS020_OP_DAMAGE, image->dx, image->dy,
+		       image->width, image->height);
+}
+
+static int ls020_update_display_full(struct ls020_fb_par *par)
+{
 	u16 *vmem = par->videomemory;
-	u8 *data_buf = par->spi_buffer;
-	int ret, i;
-	size_t buf_size = LS020_WIDTH * LS020_HEIGHT * 2;
-	
-	if (!data_buf) {
-		data_buf = kmalloc(buf_size, GFP_ATOMIC);
-		if (!data_buf) {
-			dev_warn(&par->spi->dev, "Buffer allocation failed, using slow mode\n");
-			return ls020_update_display_slow(par);
-		}
-	}
+	int ret, y;
+	
+	trace_ls020_update_full(&par->spi->dev, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
 	
 	if (!par->window_set) {
-		static const u8 setup_cmds[] = {
-			0xEF, 0x90, 0x08, 0x00, 0x09, 0x83, 0x0A, 0xAF,
-			0x0B, 0x00, 0x06, 0x00, 0x07, 0xAF
-		};
-		
-		gpiod_set_value(par->rs_gpio, LS020_CMD);
-		ret = spi_write(par->spi, setup_cmds, sizeof(setup_cmds));
-		if (ret) {
-			if (!par->spi_buffer)
-				kfree(data_buf);
+		ret = ls020_set_addr_window(par, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
+		if (ret)
 			return ret;
-		}
 		par->window_set = true;
 	}
 	
-	for (i = 0; i < LS020_WIDTH * LS020_HEIGHT; i++) {
-		u16 pixel = vmem[i];
-		data_buf[i << 1] = pixel >> 8;
-		data_buf[(i << 1) + 1] = pixel & 0xFF;
-	}
+	if (!par->pixel_bpw16 || par->stride != LS020_WIDTH)
+		return ls020_stream_rows(par, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
 	
-	gpiod_set_value(par->rs_gpio, LS020_DATA);
-	ret = spi_write(par->spi, data_buf, buf_size);
+	/* Nothing to pack: video memory goes out as is */
+	ret = ls020_flush_submit(par, ls020_flush_get_buf(par), vmem, LS020_FRAME_SIZE);
 	
 	if (par->shadow_buffer && par->partial_update) {
-		memcpy(par->shadow_buffer, vmem, LS020_WIDTH * LS020_HEIGHT * 2);
+		for (y = 0; y < LS020_HEIGHT; y++)
+			memcpy(par->shadow_buffer + y * LS020_WIDTH,
+			       vmem + y * par->stride, LS020_WIDTH * 2);
 	}
 	
-	if (!par->spi_buffer)
-		kfree(data_buf);
+	return ret;
+}
+
+/*
+ * Flushes explicitly marked tiles plus whatever changed on the scanlines in
+ * @rows. A NULL @rows skips change detection altogether.
+ */
+static int ls020_update_display(struct ls020_fb_par *par, const unsigned long *rows)
+{
+	DECLARE_BITMAP(tiles, LS020_NUM_TILES);
+	struct ls020_rect rects[LS020_MAX_RECTS];
+	int ret = 0, i, nrects;
+	
+	mutex_lock(&par->update_lock);
+	par->flush_changed = true;
+	
+	if (par->partial_update && par->shadow_buffer) {
+		unsigned int nops = ls020_drain_ops(par);
+		
+		if (rows) {
+			ktime_t start = ktime_get();
+			
+			ls020_detect_changes(par, rows);
+			ls020_stats_latency(par, LS020_STAGE_DIFF, start);
+		}
+		ls020_take_bitmap(tiles, par->dirty_tiles, LS020_NUM_TILES);
+		
+		nrects = ls020_plan_update(tiles, rects);
+		if (!nrects) {
+			par->flush_changed = nops > 0;
+			goto out;
+		}
 		
+		if (nrects > 0) {
+			ls020_stats_inc(par, &par->stats.partial_updates);
+			for (i = 0; i < nrects; i++) {
+				ret = ls020_update_display_partial(par, &rects[i]);
+				if (ret)
+					break;
+			}
+			goto out;
+		}
+		ls020_stats_inc(par, &par->stats.full_fallbacks);
+	}
+	
+	ls020_stats_inc(par, &par->stats.full_updates);
+	ret = ls020_update_display_full(par);
+out:
+	ls020_stats_frame(par, par->flush_changed);
+	mutex_unlock(&par->update_lock);
+	return ret;
+}
+
+static void ls020_gov_apply(struct ls020_fb_par *par)
+{
+	par->frame_period = ns_to_ktime(div_u64(NSEC_PER_SEC, par->fps_cur));
+}
+
+/*
+ * Refresh-rate governor. Deferred I/O only schedules a flush after a write,
+ * so an untouched framebuffer already costs nothing; this handles clients
+ * that keep rewriting identical frames. Every flush that changes something
+ * doubles the rate towards the target, and each run of unchanged flushes
+ * halves it down to fps_min.
+ */
+static void ls020_gov_update(struct ls020_fb_par *par, bool changed)
+{
+	unsigned long flags;
+	
+	spin_lock_irqsave(&par->gov_lock, flags);
+	
+	if (changed) {
+		par->idle_flushes = 0;
+		par->fps_cur = min(par->fps_cur * 2, par->fps);
+	} else if (++par->idle_flushes >= LS020_GOV_IDLE_FLUSHES) {
+		par->idle_flushes = 0;
+		par->fps_cur = max(par->fps_cur / 2, par->fps_min);
+	}
+	ls020_gov_apply(par);
+	
+	spin_unlock_irqrestore(&par->gov_lock, flags);
+}
+
+/*
+ * Hands the end of this panel's part of the frame to the completion of the
+ * last message the flush queued, or ends it right away if that message is
+ * already sent. The thread goes on to the next flush either way.
+ */
+static void ls020_frame_end(struct ls020_fb_par *par)
+{
+	struct ls020_txbuf *tx = par->tx_last;
+	
+	if (tx && atomic_xchg(&tx->state, LS020_TX_FRAME_END) == LS020_TX_QUEUED)
+		return;
+	ls020_frame_done(par);
+}
+
+/*
+ * Starts a flush on every panel. While the previous frame is still being
+ * sent, the flushes only pick up new damage and no new frame is counted.
+ */
+static enum hrtimer_restart ls020_frame_timer(struct hrtimer *timer)
+{
+	struct ls020_fb_par *par = container_of(timer, struct ls020_fb_par, frame_timer);
+	struct ls020_fb_par *p;
+	int panels = 0;
+	
+	spin_lock(&par->gov_lock);
+	par->frame_last = hrtimer_get_expires(timer);
+	spin_unlock(&par->gov_lock);
+	
+	if (!atomic_read(&par->frame_panels)) {
+		for (p = par; p; p = p->span)
+			panels++;
+		atomic_set(&par->frame_panels, panels);
+		for (p = par; p; p = p->span)
+			atomic_set(&p->frame_tick, 1);
+	}
+	
+	for (p = par; p; p = p->span)
+		kthread_queue_work(p->worker, &p->flush_work);
+	
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Schedules the next tick one frame period after the last one, or right
+ * away after an idle stretch. The clock only runs while there is damage
+ * or a vsync waiter.
+ */
+static void ls020_frame_kick(struct ls020_fb_par *par)
+{
+	unsigned long flags;
+	ktime_t next, now;
+	
+	spin_lock_irqsave(&par->gov_lock, flags);
+	if (!hrtimer_is_queued(&par->frame_timer)) {
+		now = ktime_get();
+		next = ktime_add(par->frame_last, par->frame_period);
+		hrtimer_start(&par->frame_timer, ktime_after(next, now) ? next : now,
+			      HRTIMER_MODE_ABS);
+	}
+	spin_unlock_irqrestore(&par->gov_lock, flags);
+}
+
+static void ls020_frame_clock_init(struct ls020_fb_par *par)
+{
+	atomic_set(&par->frame_panels, 0);
+	par->frame_last = 0;
+	par->vsync_seq = 0;
+	init_waitqueue_head(&par->vsync_wait);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&par->frame_timer, ls020_frame_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#else
+	hrtimer_init(&par->frame_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	par->frame_timer.function = ls020_frame_timer;
+#endif
+}
+
+static void ls020_flush_work(struct kthread_work *work)
+{
+	struct ls020_fb_par *par = container_of(work, struct ls020_fb_par, flush_work);
+	struct ls020_fb_par *owner = ls020_gov_owner(par);
+	bool tick = atomic_xchg(&par->frame_tick, 0);
+	DECLARE_BITMAP(rows, LS020_HEIGHT);
+	
+	par->tx_last = NULL;
+	
+	/* ls020_panel_init_work() ran first on the same worker */
+	if (par->init_err)
+		goto out;
+	
+	ls020_take_bitmap(rows, par->scan_rows, LS020_HEIGHT);
+	if (READ_ONCE(par->off))
+		goto out;
+	ls020_update_display(par, rows);
+	
+	if (owner)
+		ls020_gov_update(owner, par->flush_changed);
+out:
+	if (tick)
+		ls020_frame_end(par);
+}
+
+struct ls020_power_req {
+	struct kthread_work work;
+	struct ls020_fb_par *par;
+	unsigned int reason;
+	bool off;
+	int ret;
+};
+
+/*
+ * Switches the panel off when the first reason is set and back on when the
+ * last one is cleared. While off nothing is flushed; coming back on, the
+ * controller is brought up from reset and sent one full frame.
+ */
+static int ls020_panel_power(struct ls020_fb_par *par, unsigned int reason, bool off)
+{
+	struct device *dev = &par->spi->dev;
+	unsigned int mask;
+	int ret = 0;
+	
+	if (par->init_err)
+		return par->init_err;
+	
+	mutex_lock(&par->update_lock);
+	mask = off ? par->off | reason : par->off & ~reason;
+	if (!mask == !par->off)
+		goto out;
+	
+	if (mask) {
+		ls020_cmd_bytes(par, ls020_off_array, ARRAY_SIZE(ls020_off_array));
+		ret = ls020_cmd_flush(par);
+		ls020_flush_wait(par);
+		dev_dbg(dev, "Display off\n");
+	} else {
+		ret = ls020_init_display(par);
+		if (!ret)
+			ret = ls020_set_rotation(par, par->orientation);
+		par->window_set = false;
+		if (par->videomemory)
+			ls020_mark_dirty_region(par, 0, 0, LS020_WIDTH, LS020_HEIGHT);
+		dev_dbg(dev, "Display on\n");
+	}
+	
+out:
+	if (!ret)
+		WRITE_ONCE(par->off, mask);
+	mutex_unlock(&par->update_lock);
+	
+	if (!ret && !mask && par->videomemory)
+		kthread_queue_work(par->worker, &par->flush_work);
 	return ret;
 }
 
+static void ls020_power_work(struct kthread_work *work)
+{
+	struct ls020_power_req *req = container_of(work, struct ls020_power_req, work);
+	
+	req->ret = ls020_panel_power(req->par, req->reason, req->off);
+}
+
+/* Runs the switch on the panel's worker and waits for it */
+static int ls020_panel_set_off(struct ls020_fb_par *par, unsigned int reason, bool off)
+{
+	struct ls020_power_req req = {
+		.par = par,
+		.reason = reason,
+		.off = off,
+	};
+	
+	kthread_init_work(&req.work, ls020_power_work);
+	kthread_queue_work(par->worker, &req.work);
+	kthread_flush_work(&req.work);
+	return req.ret;
+}
+
 static ssize_t ls020_write(struct fb_info *info, const char __user *buf, 
 			   size_t count, loff_t *ppos)
 {
-	struct ls020_fb_par *par = info->par;
+	struct ls020_fb_par *par;
+	loff_t pos = *ppos;
 	ssize_t res;
 	
 	res = fb_sys_write(info, buf, count, ppos);
-	ls020_update_display(par);
+	
+	for (par = info->par; par; par = par->span) {
+		if (res > 0) {
+			u16 y0 = pos / info->fix.line_length;
+			u16 y1 = (pos + res - 1) / info->fix.line_length;
+			
+			ls020_mark_dirty_region(par, 0, y0, LS020_WIDTH, y1 - y0 + 1);
+		}
+		kthread_queue_work(par->worker, &par->flush_work);
+	}
+	
+	/* write() stays synchronous: it returns once the panel's thread has flushed */
+	for (par = info->par; par; par = par->span)
+		kthread_flush_work(&par->flush_work);
 	
 	return res;
 }
 
+/*
+ * Runs on the shared defio worker, so it only records which scanlines were
+ * touched and leaves the flush to the frame clock, which starts it on each
+ * panel's own worker. Spanned panels are flushed in parallel.
+ */
 static void ls020_deferred_io(struct fb_info *info, struct list_head *pagelist)
 {
-	struct ls020_fb_par *par = info->par;
-	ls020_update_display(par);
+	struct ls020_fb_par *par;
+	struct fb_deferred_io_pageref *pageref;
+	unsigned int pages = 0;
+	
+	/* Clients reporting their own damage have already said what changed */
+	if (READ_ONCE(((struct ls020_fb_par *)info->par)->damage_explicit))
+		goto flush;
+	
+	list_for_each_entry(pageref, pagelist, list) {
+		unsigned long y0 = pageref->offset / info->fix.line_length;
+		unsigned long y1 = (pageref->offset + PAGE_SIZE - 1) / info->fix.line_length;
+		unsigned long y;
+		
+		if (y0 >= LS020_HEIGHT)
+			continue;
+		y1 = min_t(unsigned long, y1, LS020_HEIGHT - 1);
+		
+		for (par = info->par; par; par = par->span)
+			for (y = y0; y <= y1; y++)
+				set_bit(y, par->scan_rows);
+		pages++;
+	}
+	
+flush:
+	par = info->par;
+	trace_ls020_defio(&par->spi->dev, pages);
+	ls020_frame_kick(par);
 }
 
-static struct fb_deferred_io ls020_defio = {
-	.delay = HZ / 40,
-	.deferred_io = ls020_deferred_io,
-};
-
 static int ls020_fb_mmap(struct fb_info *info, struct vm_area_struct *vma)
 {
 	return fb_deferred_io_mmap(info, vma);
@@ -552,6 +1434,164 @@ static int ls020_fb_pan_display(struct fb_var_screeninfo *var, struct fb_info *i
 	return 0;
 }
 
+static int ls020_fb_open(struct fb_info *info, int user)
+{
+	struct ls020_fb_par *par = info->par;
+	
+	if (user)
+		atomic_inc(&par->open_users);
+	return 0;
+}
+
+static int ls020_fb_release(struct fb_info *info, int user)
+{
+	struct ls020_fb_par *par = info->par;
+	
+	if (user && atomic_dec_and_test(&par->open_users))
+		WRITE_ONCE(par->damage_explicit, false);
+	return 0;
+}
+
+/*
+ * Rectangles are copied in small batches on the stack, so a client reporting
+ * damage every frame costs no allocation.
+ */
+static int ls020_ioctl_damage(struct fb_info *info, void __user *argp)
+{
+	struct ls020_damage_rect rects[LS020_DAMAGE_BATCH];
+	struct ls020_fb_par *par = info->par;
+	struct ls020_damage_rect __user *urects;
+	struct ls020_damage damage;
+	unsigned int i, n, done;
+	
+	if (copy_from_user(&damage, argp, sizeof(damage)))
+		return -EFAULT;
+	if (damage.num_rects > LS020_DAMAGE_MAX_RECTS || damage.flags & ~LS020_DAMAGE_FLUSH)
+		return -EINVAL;
+	
+	WRITE_ONCE(par->damage_explicit, true);
+	
+	urects = u64_to_user_ptr(damage.rects);
+	for (done = 0; done < damage.num_rects; done += n) {
+		n = min_t(unsigned int, damage.num_rects - done, LS020_DAMAGE_BATCH);
+		if (copy_from_user(rects, urects + done, n * sizeof(*rects)))
+			return -EFAULT;
+		for (i = 0; i < n; i++)
+			ls020_queue_op(info, LS020_OP_RECT, rects[i].x, rects[i].y,
+				       rects[i].width, rects[i].height);
+	}
+	
+	if (damage.flags & LS020_DAMAGE_FLUSH)
+		for (par = info->par; par; par = par->span)
+			kthread_queue_work(par->worker, &par->flush_work);
+	
+	return 0;
+}
+
+/*
+ * Blanking drops each panel's runtime PM reference as well, so the SPI
+ * controller may idle while the screen is off. Every panel keeps its own
+ * blank state, since a spanned half can outlive the framebuffer.
+ */
+static int ls020_fb_blank(int blank, struct fb_info *info)
+{
+	bool off = blank != FB_BLANK_UNBLANK;
+	struct ls020_fb_par *p;
+	int ret = 0;
+	
+	for (p = info->par; p; p = p->span) {
+		struct device *dev = &p->spi->dev;
+		int err;
+		
+		if (p->blanked == off)
+			continue;
+		p->blanked = off;
+		
+		if (off) {
+			err = ls020_panel_set_off(p, LS020_OFF_BLANK, true);
+			pm_runtime_put(dev);
+		} else {
+			pm_runtime_get_sync(dev);
+			err = ls020_panel_set_off(p, LS020_OFF_BLANK, false);
+		}
+		if (!ret)
+			ret = err;
+	}
+	
+	return ret;
+}
+
+/*
+ * Runs deferred I/O now to pick up pages written since its last run, then
+ * flushes every panel without waiting for the frame clock. A flush already
+ * queued absorbs this one; one in progress is followed by another.
+ */
+static int ls020_ioctl_present(struct fb_info *info, u32 __user *argp)
+{
+	struct ls020_fb_par *par;
+	u32 flags;
+	
+	if (get_user(flags, argp))
+		return -EFAULT;
+	if (flags & ~LS020_PRESENT_WAIT)
+		return -EINVAL;
+	
+	flush_delayed_work(&info->deferred_work);
+	
+	for (par = info->par; par; par = par->span)
+		kthread_queue_work(par->worker, &par->flush_work);
+	
+	if (flags & LS020_PRESENT_WAIT)
+		for (par = info->par; par; par = par->span)
+			kthread_flush_work(&par->flush_work);
+	
+	return 0;
+}
+
+/* Waits for the next frame of the frame clock to be sent */
+static int ls020_ioctl_waitforvsync(struct fb_info *info, u32 __user *argp)
+{
+	struct ls020_fb_par *par = info->par;
+	unsigned long seq;
+	long ret;
+	u32 crtc;
+	
+	if (get_user(crtc, argp))
+		return -EFAULT;
+	if (crtc)
+		return -ENODEV;
+	
+	seq = READ_ONCE(par->vsync_seq);
+	ls020_frame_kick(par);
+	ret = wait_event_interruptible_timeout(par->vsync_wait,
+					       READ_ONCE(par->vsync_seq) != seq,
+					       LS020_VSYNC_TIMEOUT);
+	if (ret < 0)
+		return ret;
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+static int ls020_fb_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	switch (cmd) {
+	case LS020_IOCTL_DAMAGE:
+		return ls020_ioctl_damage(info, (void __user *)arg);
+	case LS020_IOCTL_PRESENT:
+		return ls020_ioctl_present(info, (u32 __user *)arg);
+	case FBIO_WAITFORVSYNC:
+		return ls020_ioctl_waitforvsync(info, (u32 __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+static int ls020_fb_compat_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	return ls020_fb_ioctl(info, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
 static struct fb_ops ls020_fbops = {
 	.owner = THIS_MODULE,
 	.fb_write = ls020_write,
@@ -560,62 +1600,207 @@ static struct fb_ops ls020_fbops = {
 	.fb_imageblit = ls020_imageblit,
 	.fb_mmap = ls020_fb_mmap,
 	.fb_pan_display = ls020_fb_pan_display,
+	.fb_blank = ls020_fb_blank,
+	.fb_open = ls020_fb_open,
+	.fb_release = ls020_fb_release,
+	.fb_ioctl = ls020_fb_ioctl,
+#ifdef CONFIG_COMPAT
+	.fb_compat_ioctl = ls020_fb_compat_ioctl,
+#endif
 };
 
-static int ls020_fb_probe(struct spi_device *spi)
+static int ls020_stats_debugfs_show(struct seq_file *m, void *unused)
 {
-	struct device *dev = &spi->dev;
-	struct fb_info *info;
-	struct ls020_fb_par *par;
-	int retval = 0;
+	static const char * const stage_names[LS020_NUM_STAGES] = {
+		[LS020_STAGE_DIFF] = "diff",
+		[LS020_STAGE_PACK] = "pack",
+		[LS020_STAGE_XFER] = "xfer",
+	};
+	struct ls020_fb_par *par = m->private;
+	struct ls020_fb_par *owner = ls020_gov_owner(par);
+	struct ls020_stats st;
+	unsigned long flags;
+	int stage, i;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	st = par->stats;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+	
+	seq_printf(m, "frames_flushed:  %llu\n", st.frames_flushed);
+	seq_printf(m, "frames_skipped:  %llu\n", st.frames_skipped);
+	seq_printf(m, "partial_updates: %llu\n", st.partial_updates);
+	seq_printf(m, "full_updates:    %llu\n", st.full_updates);
+	seq_printf(m, "full_fallbacks:  %llu\n", st.full_fallbacks);
+	seq_printf(m, "bytes_sent:      %llu\n", st.bytes_sent);
+	/* A span secondary that is not attached has no refresh rate of its own */
+	if (owner) {
+		seq_printf(m, "fps_requested:   %u\n", READ_ONCE(owner->fps));
+		seq_printf(m, "fps_current:     %u\n", READ_ONCE(owner->fps_cur));
+	} else {
+		seq_puts(m, "fps_requested:   n/a\n");
+		seq_puts(m, "fps_current:     n/a\n");
+	}
+	seq_printf(m, "fps_achieved:    %u\n", ls020_stats_fps(par));
+	
+	for (stage = 0; stage < LS020_NUM_STAGES; stage++) {
+		seq_printf(m, "\n%s latency (us):\n", stage_names[stage]);
+		for (i = 0; i < LS020_HIST_BUCKETS; i++) {
+			if (!st.hist[stage][i])
+				continue;
+			if (i == 0)
+				seq_printf(m, "  %6s %6u: %llu\n", "<", 1, st.hist[stage][i]);
+			else if (i == LS020_HIST_BUCKETS - 1)
+				seq_printf(m, "  %6s %6u: %llu\n", ">=", 1U << (i - 1),
+					   st.hist[stage][i]);
+			else
+				seq_printf(m, "  %6u-%6u: %llu\n", 1U << (i - 1), (1U << i) - 1,
+					   st.hist[stage][i]);
+		}
+	}
 	
-	dev_info(dev, "LS020 framebuffer driver probing\n");
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ls020_stats_debugfs);
+
+/*
+ * Resets and initialises the controller on the panel's worker, so probe and
+ * framebuffer registration do not wait out the reset delays. Flushes queued
+ * meanwhile run after it.
+ */
+static void ls020_panel_init_work(struct kthread_work *work)
+{
+	struct ls020_fb_par *par = container_of(work, struct ls020_fb_par, init_work);
+	struct device *dev = &par->spi->dev;
+	int retval;
 	
-	info = framebuffer_alloc(sizeof(struct ls020_fb_par), dev);
-	if (!info) {
-		dev_err(dev, "Couldn't allocate framebuffer.\n");
-		retval = -ENOMEM;
-		goto fballoc_fail;
+	retval = ls020_init_display(par);
+	if (retval < 0) {
+		dev_err(dev, "Display initialization failed.\n");
+		goto out;
 	}
 	
-	par = info->par;
+	retval = ls020_set_rotation(par, rotation & 3);
+	if (retval < 0) {
+		dev_err(dev, "Failed to set rotation.\n");
+		goto out;
+	}
+	
+	dev_info(dev, "Display rotation set to %d° (parameter: %d)\n",
+		 (rotation & 3) * 90, rotation);
+	
+out:
+	par->init_err = retval;
+}
+
+static void ls020_panel_release(struct ls020_fb_par *par)
+{
+	debugfs_remove_recursive(par->debugfs);
+	par->debugfs = NULL;
+	
+	if (par->worker) {
+		kthread_destroy_worker(par->worker);
+		par->worker = NULL;
+	}
+	
+	ls020_flush_free(par);
+	
+	if (par->shadow_buffer) {
+		vfree(par->shadow_buffer);
+		par->shadow_buffer = NULL;
+	}
+}
+
+/*
+ * One thread per panel sends everything that goes to it, so frame timing
+ * does not depend on what else the system workqueues are busy with.
+ * Modules cannot pick an arbitrary RT priority; the two SCHED_FIFO levels
+ * the kernel exports are offered instead. The flush-cpu property pins each
+ * panel's thread on its own, so spanned halves can run on separate cores.
+ */
+static int ls020_worker_create(struct ls020_fb_par *par)
+{
+	struct device *dev = &par->spi->dev;
+	struct kthread_worker *worker;
+	struct task_struct *task;
+	int cpu = flush_cpu;
+	u32 val;
+	
+	worker = kthread_create_worker(0, "ls020/%s", dev_name(dev));
+	if (IS_ERR(worker)) {
+		dev_err(dev, "Couldn't create flush thread.\n");
+		return PTR_ERR(worker);
+	}
+	par->worker = worker;
+	task = worker->task;
+	
+	switch (flush_sched) {
+	case 0:
+		sched_set_normal(task, clamp(flush_nice, MIN_NICE, MAX_NICE));
+		break;
+	case 1:
+		sched_set_fifo_low(task);
+		break;
+	default:
+		sched_set_fifo(task);
+		break;
+	}
+	
+	if (!device_property_read_u32(dev, "flush-cpu", &val))
+		cpu = min_t(u32, val, INT_MAX);
+	
+	if (cpu >= 0) {
+		if (cpu < nr_cpu_ids && cpu_online(cpu))
+			set_cpus_allowed_ptr(task, cpumask_of(cpu));
+		else
+			dev_warn(dev, "CPU %d is not online, flush thread left unbound\n",
+				 cpu);
+	}
+	
+	return 0;
+}
+
+/*
+ * Brings up everything a single panel needs, whether it owns a framebuffer
+ * or is the second half of a spanned one.
+ */
+static int ls020_panel_setup(struct ls020_fb_par *par, struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	int retval;
+	
 	par->spi = spi;
-	par->info = info;
 	par->orientation = 0;
 	par->invert = false;
+	par->stride = LS020_WIDTH;
+	par->x_offset = 0;
 	
 	par->rst_gpio = devm_gpiod_get(dev, "ls020-reset", GPIOD_OUT_LOW);
 	if (IS_ERR(par->rst_gpio)) {
 		dev_err(dev, "Failed to get reset GPIO\n");
-		retval = PTR_ERR(par->rst_gpio);
-		goto gpio_fail;
+		return PTR_ERR(par->rst_gpio);
 	}
 	
 	par->rs_gpio = devm_gpiod_get(dev, "ls020-dc", GPIOD_OUT_LOW);
 	if (IS_ERR(par->rs_gpio)) {
 		dev_err(dev, "Failed to get RS/DC GPIO\n");
-		retval = PTR_ERR(par->rs_gpio);
-		goto gpio_fail;
-	}
-	
-	par->videomemory = vzalloc(LS020_WIDTH * LS020_HEIGHT * 2);
-	if (!par->videomemory) {
-		dev_err(dev, "Couldn't allocate video memory.\n");
-		retval = -ENOMEM;
-		goto videomem_alloc_fail;
+		return PTR_ERR(par->rs_gpio);
 	}
 	
-	par->spi_buffer = kmalloc(LS020_WIDTH * LS020_HEIGHT * 2, GFP_KERNEL);
-	if (!par->spi_buffer) {
-		dev_warn(dev, "Couldn't allocate SPI buffer, will use temporary buffers\n");
-	} else {
-		dev_info(dev, "SPI buffer allocated for optimized performance\n");
+	retval = ls020_flush_alloc(par);
+	if (retval) {
+		dev_err(dev, "Couldn't allocate SPI transfer buffers.\n");
+		goto fail;
 	}
+	dev_info(dev, "%d SPI transfer buffers allocated for async flushing\n",
+		 LS020_NUM_TXBUF);
 	
 	par->window_set = false;
 	par->partial_update = partial_update;
-	par->dirty_pending = false;
-	spin_lock_init(&par->dirty_lock);
+	bitmap_zero(par->dirty_tiles, LS020_NUM_TILES);
+	bitmap_zero(par->scan_rows, LS020_HEIGHT);
+	mutex_init(&par->update_lock);
+	spin_lock_init(&par->ops_lock);
+	par->nops = 0;
 	
 	if (par->partial_update) {
 		par->shadow_buffer = vzalloc(LS020_WIDTH * LS020_HEIGHT * 2);
@@ -627,12 +1812,225 @@ static int ls020_fb_probe(struct spi_device *spi)
 		}
 	}
 	
+	retval = ls020_worker_create(par);
+	if (retval)
+		goto fail;
+	kthread_init_work(&par->flush_work, ls020_flush_work);
+	
+	if (device_property_read_u32(dev, "fps", &par->fps))
+		par->fps = fps;
+	if (par->fps < 1 || par->fps > LS020_FPS_MAX) {
+		dev_warn(dev, "Invalid FPS %u, using default 40\n", par->fps);
+		par->fps = 40;
+	}
+	par->fps_min = clamp_t(int, fps_min, 1, par->fps);
+	par->fps_cur = par->fps;
+	par->idle_flushes = 0;
+	spin_lock_init(&par->gov_lock);
+	
+	spin_lock_init(&par->stats_lock);
+	ls020_stats_reset(par);
+	par->debugfs = debugfs_create_dir(dev_name(dev), ls020_debugfs_root);
+	debugfs_create_file("stats", 0444, par->debugfs, par, &ls020_stats_debugfs_fops);
+	
+	spi->max_speed_hz = 30000000;
+	spi->mode = SPI_MODE_0;
+	spi->bits_per_word = 8;
+	retval = spi_setup(spi);
+	if (retval < 0) {
+		dev_err(dev, "SPI setup failed.\n");
+		goto fail;
+	}
+	
+	par->color8 = color8;
+	par->dither = dither;
+	par->pixel_bpw16 = !par->color8 && spi_is_bpw_supported(spi, 16);
+	if (par->color8)
+		dev_info(dev, "Pixel data sent as 8-bit RGB332%s\n",
+			 par->dither ? ", dithered" : "");
+	else
+		dev_info(dev, "Pixel data sent as %d-bit SPI words\n",
+			 par->pixel_bpw16 ? 16 : 8);
+	
+	kthread_init_work(&par->init_work, ls020_panel_init_work);
+	kthread_queue_work(par->worker, &par->init_work);
+	
+	return 0;
+
+fail:
+	ls020_panel_release(par);
+	return retval;
+}
+
+/* The panel is on after probe; unblanked panels hold a runtime PM reference */
+static void ls020_pm_enable(struct device *dev)
+{
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_enable(dev);
+}
+
+static void ls020_pm_disable(struct ls020_fb_par *par)
+{
+	struct device *dev = &par->spi->dev;
+	
+	pm_runtime_disable(dev);
+	if (!par->blanked)
+		pm_runtime_put_noidle(dev);
+	pm_runtime_set_suspended(dev);
+}
+
+/*
+ * A panel marked siemens,span-secondary has no framebuffer of its own. It is
+ * initialised and parked until the panel that references it through
+ * siemens,span-partner probes and takes it over as its right-hand half.
+ */
+static int ls020_span_secondary_probe(struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	struct ls020_fb_par *par;
+	int retval;
+	
+	par = devm_kzalloc(dev, sizeof(*par), GFP_KERNEL);
+	if (!par)
+		return -ENOMEM;
+	
+	retval = ls020_panel_setup(par, spi);
+	if (retval)
+		return retval;
+	
+	par->span_secondary = true;
+	spi_set_drvdata(spi, par);
+	ls020_pm_enable(dev);
+	
+	mutex_lock(&ls020_span_lock);
+	list_add_tail(&par->span_node, &ls020_span_list);
+	mutex_unlock(&ls020_span_lock);
+	
+	dev_info(dev, "LS020 panel waiting to be spanned\n");
+	return 0;
+}
+
+static struct ls020_fb_par *ls020_span_claim(struct device *dev)
+{
+	struct device_node *np;
+	struct ls020_fb_par *p, *partner = NULL;
+	
+	np = of_parse_phandle(dev->of_node, "siemens,span-partner", 0);
+	if (!np)
+		return NULL;
+	
+	mutex_lock(&ls020_span_lock);
+	list_for_each_entry(p, &ls020_span_list, span_node) {
+		if (p->spi->dev.of_node == np && !p->span_attached) {
+			p->span_attached = true;
+			partner = p;
+			break;
+		}
+	}
+	mutex_unlock(&ls020_span_lock);
+	of_node_put(np);
+	
+	return partner ? partner : ERR_PTR(-EPROBE_DEFER);
+}
+
+static void ls020_span_release(struct ls020_fb_par *par)
+{
+	struct ls020_fb_par *partner = par->span;
+	
+	if (!partner)
+		return;
+	
+	kthread_cancel_work_sync(&partner->flush_work);
+	
+	/* Its last frame may still be on the wire and end on the owner */
+	mutex_lock(&partner->update_lock);
+	ls020_flush_wait(partner);
+	mutex_unlock(&partner->update_lock);
+	
+	mutex_lock(&ls020_span_lock);
+	partner->videomemory = NULL;
+	partner->span_owner = NULL;
+	partner->stride = LS020_WIDTH;
+	partner->x_offset = 0;
+	partner->span_attached = false;
+	mutex_unlock(&ls020_span_lock);
+	
+	/* The next owner starts unblanked and would never undo this */
+	if (partner->blanked) {
+		pm_runtime_get_sync(&partner->spi->dev);
+		ls020_panel_set_off(partner, LS020_OFF_BLANK, false);
+		partner->blanked = false;
+	}
+	
+	par->span = NULL;
+}
+
+static int ls020_fb_probe(struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	struct fb_info *info;
+	struct ls020_fb_par *par, *partner, *p;
+	unsigned int width;
+	int retval = 0;
+	
+	dev_info(dev, "LS020 framebuffer driver probing\n");
+	
+	if (device_property_read_bool(dev, "siemens,span-secondary"))
+		return ls020_span_secondary_probe(spi);
+	
+	partner = ls020_span_claim(dev);
+	if (IS_ERR(partner))
+		return dev_err_probe(dev, PTR_ERR(partner), "Span partner not ready\n");
+	
+	info = framebuffer_alloc(sizeof(struct ls020_fb_par), dev);
+	if (!info) {
+		dev_err(dev, "Couldn't allocate framebuffer.\n");
+		retval = -ENOMEM;
+		goto fballoc_fail;
+	}
+	
+	par = info->par;
+	par->info = info;
+	par->span = partner;
+	
+	retval = ls020_panel_setup(par, spi);
+	if (retval)
+		goto panel_fail;
+	
+	width = partner ? 2 * LS020_WIDTH : LS020_WIDTH;
+	
+	par->videomemory = vzalloc(width * LS020_HEIGHT * 2);
+	if (!par->videomemory) {
+		dev_err(dev, "Couldn't allocate video memory.\n");
+		retval = -ENOMEM;
+		goto videomem_alloc_fail;
+	}
+	par->stride = width;
+	
+	if (partner) {
+		if (!device_link_add(dev, &partner->spi->dev, DL_FLAG_AUTOREMOVE_CONSUMER))
+			dev_warn(dev, "Failed to link span partner %s\n",
+				 dev_name(&partner->spi->dev));
+		partner->videomemory = par->videomemory + LS020_WIDTH;
+		partner->stride = width;
+		partner->x_offset = LS020_WIDTH;
+		partner->span_owner = par;
+		dev_info(dev, "Spanning framebuffer across %s\n",
+			 dev_name(&partner->spi->dev));
+	}
+	
+	par->glyph_cache = kcalloc(LS020_GLYPH_CACHE_SIZE, sizeof(*par->glyph_cache),
+				   GFP_KERNEL);
+	if (!par->glyph_cache)
+		dev_warn(dev, "Failed to allocate glyph cache, using generic imageblit\n");
+	
 	info->screen_base = (char __iomem *)par->videomemory;
-	info->screen_size = LS020_WIDTH * LS020_HEIGHT * 2;
+	info->screen_size = width * LS020_HEIGHT * 2;
 	info->fbops = &ls020_fbops;
-	info->var.xres = LS020_WIDTH;
+	info->var.xres = width;
 	info->var.yres = LS020_HEIGHT;
-	info->var.xres_virtual = LS020_WIDTH;
+	info->var.xres_virtual = width;
 	info->var.yres_virtual = LS020_HEIGHT;
 	info->var.xoffset = 0;
 	info->var.yoffset = 0;
@@ -649,7 +2047,7 @@ static int ls020_fb_probe(struct spi_device *spi)
 	info->fix.smem_len = info->screen_size;
 	info->fix.type = FB_TYPE_PACKED_PIXELS;
 	info->fix.visual = FB_VISUAL_TRUECOLOR;
-	info->fix.line_length = LS020_WIDTH * 2;
+	info->fix.line_length = width * 2;
 	info->fix.accel = FB_ACCEL_NONE;
 	info->fix.xpanstep = 0;
 	info->fix.ypanstep = 0;
@@ -657,56 +2055,31 @@ static int ls020_fb_probe(struct spi_device *spi)
 	info->pseudo_palette = par->pseudo_palette;
 	info->flags = FBINFO_VIRTFB;
 	
-	if (fps < 1 || fps > 120) {
-		dev_warn(dev, "Invalid FPS %d, using default 40\n", fps);
-		fps = 40;
-	}
-	ls020_defio.delay = HZ / fps;
-	info->fbdefio = &ls020_defio;
-	fb_deferred_io_init(info);
-	
-	dev_info(dev, "Deferred I/O configured for %d FPS (delay: %ld jiffies)\n", 
-		 fps, ls020_defio.delay);
+	ls020_gov_apply(par);
+	ls020_frame_clock_init(par);
 	
-	spi->max_speed_hz = 30000000;
-	spi->mode = SPI_MODE_0;
-	spi->bits_per_word = 8;
-	retval = spi_setup(spi);
-	if (retval < 0) {
-		dev_err(dev, "SPI setup failed.\n");
-		goto spi_setup_fail;
-	}
-	
-	retval = ls020_init_display(par);
-	if (retval < 0) {
-		dev_err(dev, "Display initialization failed.\n");
-		goto init_fail;
-	}
-	
-	retval = ls020_set_rotation(par, rotation & 3);
-	if (retval < 0) {
-		dev_err(dev, "Failed to set rotation.\n");
-		goto init_fail;
-	}
-	
-	dev_info(dev, "Display rotation set to %d° (parameter: %d)\n", 
-		 (rotation & 3) * 90, rotation);
+	/* Faults are gathered for a jiffy; the frame clock paces the flushes */
+	par->defio.delay = 1;
+	par->defio.deferred_io = ls020_deferred_io;
+	info->fbdefio = &par->defio;
+	fb_deferred_io_init(info);
 	
-	dev_info(dev, "Drawing test pattern\n");
-	for (int i = 0; i < LS020_WIDTH * LS020_HEIGHT; i++) {
-		if (i < (LS020_WIDTH * LS020_HEIGHT / 3))
-			par->videomemory[i] = 0xF800;
-		else if (i < (2 * LS020_WIDTH * LS020_HEIGHT / 3))
-			par->videomemory[i] = 0x07E0;
-		else
-			par->videomemory[i] = 0x001F;
+	dev_info(dev, "Frame clock set to %u FPS (period: %lld ns)\n",
+		 par->fps, ktime_to_ns(par->frame_period));
+	
+	if (test_pattern) {
+		dev_info(dev, "Drawing test pattern\n");
+		for (int i = 0; i < width * LS020_HEIGHT; i++) {
+			if (i < (width * LS020_HEIGHT / 3))
+				par->videomemory[i] = 0xF800;
+			else if (i < (2 * width * LS020_HEIGHT / 3))
+				par->videomemory[i] = 0x07E0;
+			else
+				par->videomemory[i] = 0x001F;
+		}
 	}
 	
-	retval = ls020_update_display(par);
-	if (retval < 0) {
-		dev_err(dev, "Failed to update display with test pattern.\n");
-		goto init_fail;
-	}
+	spi_set_drvdata(spi, par);
 	
 	info->node = 0;
 	retval = register_framebuffer(info);
@@ -715,49 +2088,70 @@ static int ls020_fb_probe(struct spi_device *spi)
 		goto register_fail;
 	}
 	
-	spi_set_drvdata(spi, info);
+	ls020_pm_enable(dev);
 	
-	dev_info(dev, "LS020 framebuffer %dx%d registered\n", 
-		 LS020_WIDTH, LS020_HEIGHT);
+	/* The first frame overwrites whatever the panel RAM held after reset */
+	for (p = par; p; p = p->span) {
+		ls020_mark_dirty_region(p, 0, 0, LS020_WIDTH, LS020_HEIGHT);
+		kthread_queue_work(p->worker, &p->flush_work);
+	}
+	
+	dev_info(dev, "LS020 framebuffer %ux%d registered\n", 
+		 width, LS020_HEIGHT);
 	
 	return 0;
 
 register_fail:
-init_fail:
-spi_setup_fail:
 	fb_deferred_io_cleanup(info);
-	if (par->spi_buffer)
-		kfree(par->spi_buffer);
-	if (par->shadow_buffer)
-		vfree(par->shadow_buffer);
+	kfree(par->glyph_cache);
+	ls020_span_release(par);
 	vfree(par->videomemory);
 videomem_alloc_fail:
-gpio_fail:
+	ls020_panel_release(par);
+panel_fail:
+	ls020_span_release(par);
 	framebuffer_release(info);
+	return retval;
+
 fballoc_fail:
+	if (partner) {
+		mutex_lock(&ls020_span_lock);
+		partner->span_attached = false;
+		mutex_unlock(&ls020_span_lock);
+	}
 	return retval;
 }
 
 static void ls020_fb_remove(struct spi_device *spi)
 {
-	struct fb_info *info = spi_get_drvdata(spi);
-	struct ls020_fb_par *par;
+	struct ls020_fb_par *par = spi_get_drvdata(spi);
+	struct fb_info *info;
 	
-	if (!info)
+	if (!par)
 		return;
-		
-	par = info->par;
+	
+	ls020_pm_disable(par);
+	
+	if (par->span_secondary) {
+		mutex_lock(&ls020_span_lock);
+		list_del(&par->span_node);
+		mutex_unlock(&ls020_span_lock);
+		ls020_panel_release(par);
+		return;
+	}
+	
+	info = par->info;
 	
 	unregister_framebuffer(info);
 	fb_deferred_io_cleanup(info);
+	hrtimer_cancel(&par->frame_timer);
+	kthread_cancel_work_sync(&par->flush_work);
+	ls020_span_release(par);
 	
-	if (par->spi_buffer) {
-		kfree(par->spi_buffer);
-		dev_info(&spi->dev, "SPI buffer freed\n");
-	}
+	ls020_panel_release(par);
+	dev_info(&spi->dev, "SPI transfer buffers freed\n");
 	
-	if (par->shadow_buffer)
-		vfree(par->shadow_buffer);
+	kfree(par->glyph_cache);
 		
 	if (par->videomemory)
 		vfree(par->videomemory);
@@ -767,6 +2161,210 @@ static void ls020_fb_remove(struct spi_device *spi)
 	dev_info(&spi->dev, "LS020 framebuffer driver removed\n");
 }
 
+static int ls020_pm_set_off(struct device *dev, unsigned int reason, bool off)
+{
+	struct ls020_fb_par *par = dev_get_drvdata(dev);
+	
+	if (!par)
+		return 0;
+	return ls020_panel_set_off(par, reason, off);
+}
+
+static int ls020_suspend(struct device *dev)
+{
+	return ls020_pm_set_off(dev, LS020_OFF_SUSPEND, true);
+}
+
+static int ls020_resume(struct device *dev)
+{
+	return ls020_pm_set_off(dev, LS020_OFF_SUSPEND, false);
+}
+
+static int ls020_runtime_suspend(struct device *dev)
+{
+	return ls020_pm_set_off(dev, LS020_OFF_RUNTIME, true);
+}
+
+static int ls020_runtime_resume(struct device *dev)
+{
+	return ls020_pm_set_off(dev, LS020_OFF_RUNTIME, false);
+}
+
+static const struct dev_pm_ops ls020_pm_ops = {
+	SYSTEM_SLEEP_PM_OPS(ls020_suspend, ls020_resume)
+	RUNTIME_PM_OPS(ls020_runtime_suspend, ls020_runtime_resume, NULL)
+};
+
+static ssize_t fps_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ls020_fb_par *par = ls020_gov_owner(dev_get_drvdata(dev));
+	
+	if (!par)
+		return -ENODEV;
+	return sysfs_emit(buf, "%u\n", par->fps);
+}
+
+static ssize_t fps_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct ls020_fb_par *par = ls020_gov_owner(dev_get_drvdata(dev));
+	unsigned long flags;
+	unsigned int val;
+	int ret;
+	
+	if (!par)
+		return -ENODEV;
+	
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val < 1 || val > LS020_FPS_MAX)
+		return -EINVAL;
+	
+	spin_lock_irqsave(&par->gov_lock, flags);
+	par->fps = val;
+	par->fps_min = min(par->fps_min, val);
+	par->fps_cur = val;
+	ls020_gov_apply(par);
+	spin_unlock_irqrestore(&par->gov_lock, flags);
+	
+	return count;
+}
+static DEVICE_ATTR_RW(fps);
+
+static ssize_t fps_min_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ls020_fb_par *par = ls020_gov_owner(dev_get_drvdata(dev));
+	
+	if (!par)
+		return -ENODEV;
+	return sysfs_emit(buf, "%u\n", par->fps_min);
+}
+
+static ssize_t fps_min_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct ls020_fb_par *par = ls020_gov_owner(dev_get_drvdata(dev));
+	unsigned long flags;
+	unsigned int val;
+	int ret;
+	
+	if (!par)
+		return -ENODEV;
+	
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	
+	spin_lock_irqsave(&par->gov_lock, flags);
+	if (val < 1 || val > par->fps) {
+		spin_unlock_irqrestore(&par->gov_lock, flags);
+		return -EINVAL;
+	}
+	par->fps_min = val;
+	par->fps_cur = max(par->fps_cur, val);
+	ls020_gov_apply(par);
+	spin_unlock_irqrestore(&par->gov_lock, flags);
+	
+	return count;
+}
+static DEVICE_ATTR_RW(fps_min);
+
+static ssize_t fps_current_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct ls020_fb_par *par = ls020_gov_owner(dev_get_drvdata(dev));
+	
+	if (!par)
+		return -ENODEV;
+	return sysfs_emit(buf, "%u\n", READ_ONCE(par->fps_cur));
+}
+static DEVICE_ATTR_RO(fps_current);
+
+static struct attribute *ls020_attrs[] = {
+	&dev_attr_fps.attr,
+	&dev_attr_fps_min.attr,
+	&dev_attr_fps_current.attr,
+	NULL,
+};
+
+static const struct attribute_group ls020_group = {
+	.attrs = ls020_attrs,
+};
+
+static u64 ls020_stats_read(struct ls020_fb_par *par, const u64 *counter)
+{
+	unsigned long flags;
+	u64 val;
+	
+	spin_lock_irqsave(&par->stats_lock, flags);
+	val = *counter;
+	spin_unlock_irqrestore(&par->stats_lock, flags);
+	
+	return val;
+}
+
+#define LS020_STAT_ATTR(name)							\
+static ssize_t name##_show(struct device *dev, struct device_attribute *attr,	\
+			   char *buf)						\
+{										\
+	struct ls020_fb_par *par = dev_get_drvdata(dev);			\
+										\
+	return sysfs_emit(buf, "%llu\n", ls020_stats_read(par, &par->stats.name));	\
+}										\
+static DEVICE_ATTR_RO(name)
+
+LS020_STAT_ATTR(frames_flushed);
+LS020_STAT_ATTR(frames_skipped);
+LS020_STAT_ATTR(partial_updates);
+LS020_STAT_ATTR(full_updates);
+LS020_STAT_ATTR(full_fallbacks);
+LS020_STAT_ATTR(bytes_sent);
+
+static ssize_t fps_achieved_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", ls020_stats_fps(dev_get_drvdata(dev)));
+}
+static DEVICE_ATTR_RO(fps_achieved);
+
+static ssize_t reset_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	bool val;
+	int ret;
+	
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+	if (val)
+		ls020_stats_reset(dev_get_drvdata(dev));
+	
+	return count;
+}
+static DEVICE_ATTR_WO(reset);
+
+static struct attribute *ls020_stats_attrs[] = {
+	&dev_attr_frames_flushed.attr,
+	&dev_attr_frames_skipped.attr,
+	&dev_attr_partial_updates.attr,
+	&dev_attr_full_updates.attr,
+	&dev_attr_full_fallbacks.attr,
+	&dev_attr_bytes_sent.attr,
+	&dev_attr_fps_achieved.attr,
+	&dev_attr_reset.attr,
+	NULL,
+};
+
+static const struct attribute_group ls020_stats_group = {
+	.name = "stats",
+	.attrs = ls020_stats_attrs,
+};
+
+static const struct attribute_group *ls020_groups[] = {
+	&ls020_group,
+	&ls020_stats_group,
+	NULL,
+};
+
 static const struct of_device_id ls020_of_match[] = {
 	{ .compatible = "siemens,ls020" },
 	{},
@@ -783,13 +2381,440 @@ static struct spi_driver ls020_fb_driver = {
 	.driver = {
 		.name = DRIVER_NAME,
 		.of_match_table = ls020_of_match,
+		.dev_groups = ls020_groups,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.pm = pm_ptr(&ls020_pm_ops),
 	},
 	.id_table = ls020_ids,
 	.probe = ls020_fb_probe,
 	.remove = ls020_fb_remove,
 };
 
-module_spi_driver(ls020_fb_driver);
+#if IS_ENABLED(CONFIG_FB_LS020_SELFTEST)
+static int __init ls020_diff_selftest(void)
+{
+	DECLARE_BITMAP(rows, LS020_HEIGHT);
+	DECLARE_BITMAP(tiles_words, LS020_NUM_TILES);
+	DECLARE_BITMAP(tiles_scalar, LS020_NUM_TILES);
+	u16 *vmem, *shadow;
+	int iter, i, ret = 0;
+	unsigned int y;
+	
+	vmem = vzalloc(LS020_FRAME_SIZE);
+	shadow = vzalloc(LS020_FRAME_SIZE);
+	if (!vmem || !shadow) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	
+	bitmap_fill(rows, LS020_HEIGHT);
+	
+	for (iter = 0; iter < 256; iter++) {
+		int changes = get_random_u32() % 64;
+		
+		for (i = 0; i < LS020_WIDTH * LS020_HEIGHT; i++)
+			vmem[i] = get_random_u32();
+		memcpy(shadow, vmem, LS020_FRAME_SIZE);
+		for (i = 0; i < changes; i++)
+			vmem[get_random_u32() % (LS020_WIDTH * LS020_HEIGHT)] ^= 1 << (i & 15);
+		
+		bitmap_zero(tiles_words, LS020_NUM_TILES);
+		bitmap_zero(tiles_scalar, LS020_NUM_TILES);
+		
+		ls020_diff_rows(vmem, LS020_WIDTH, shadow, rows, tiles_words);
+		for_each_set_bit(y, rows, LS020_HEIGHT)
+			ls020_diff_row_scalar(vmem + y * LS020_WIDTH, shadow + y * LS020_WIDTH,
+					      tiles_scalar, (y / LS020_TILE_SIZE) * LS020_TILES_X);
+		
+		if (!bitmap_equal(tiles_words, tiles_scalar, LS020_NUM_TILES)) {
+			pr_err(DRIVER_NAME ": diff selftest mismatch at frame %d\n", iter);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+	
+	pr_info(DRIVER_NAME ": diff selftest passed (%d frames)\n", iter);
+out:
+	vfree(shadow);
+	vfree(vmem);
+	return ret;
+}
+
+/* Limit the fake controller reports, so frames are split into several transfers */
+#define LS020_SELFTEST_MAX_XFER 4096
+
+/*
+ * A driver instance wired to a software SPI controller instead of a panel.
+ * The controller feeds every transfer, as a command or as pixel data
+ * depending on the driver's D/C level, into the panel model.
+ */
+struct ls020_selftest_ctx {
+	struct ls020_fb_par par;
+	u16 vmem[LS020_WIDTH * LS020_HEIGHT];
+	struct ls020_model model;
+	DECLARE_BITMAP(rows, LS020_HEIGHT);
+	struct device *parent;
+	struct spi_controller *ctlr;
+	bool capture;
+};
+
+static size_t __init ls020_selftest_max_transfer(struct spi_device *spi)
+{
+	return LS020_SELFTEST_MAX_XFER;
+}
+
+static int __init ls020_selftest_transfer(struct spi_controller *ctlr, struct spi_message *msg)
+{
+	struct ls020_selftest_ctx *ctx = *(struct ls020_selftest_ctx **)spi_controller_get_devdata(ctlr);
+	struct spi_transfer *xfer;
+	
+	list_for_each_entry(xfer, &msg->transfers, transfer_list) {
+		if (xfer->len > LS020_SELFTEST_MAX_XFER)
+			ls020_model_error(&ctx->model, "transfer above the controller's limit");
+		else if (!ctx->capture)
+			;
+		else if (READ_ONCE(ctx->par.dc_level) == LS020_CMD)
+			ls020_model_cmd(&ctx->model, xfer->tx_buf, xfer->len);
+		else
+			ls020_model_data(&ctx->model, xfer->tx_buf, xfer->len,
+					 xfer->bits_per_word == 16);
+		msg->actual_length += xfer->len;
+	}
+	
+	msg->status = 0;
+	spi_finalize_current_message(ctlr);
+	return 0;
+}
+
+/*
+ * Registers the fake controller with one device on it and sets up the parts
+ * of the driver state that ls020_panel_setup() would, minus GPIOs and the
+ * flush thread. With no D/C GPIO the driver still tracks the level itself.
+ */
+static int __init ls020_selftest_setup(struct ls020_selftest_ctx *ctx)
+{
+	struct ls020_fb_par *par = &ctx->par;
+	struct spi_controller *ctlr;
+	struct spi_device *spi;
+	int ret;
+	
+	ctx->parent = root_device_register(DRIVER_NAME "_selftest");
+	if (IS_ERR(ctx->parent))
+		return PTR_ERR(ctx->parent);
+	
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	ctlr = spi_alloc_host(ctx->parent, sizeof(ctx));
+#else
+	ctlr = spi_alloc_master(ctx->parent, sizeof(ctx));
+#endif
+	if (!ctlr) {
+		ret = -ENOMEM;
+		goto parent_fail;
+	}
+	*(struct ls020_selftest_ctx **)spi_controller_get_devdata(ctlr) = ctx;
+	ctlr->bus_num = -1;
+	ctlr->num_chipselect = 1;
+	ctlr->bits_per_word_mask = SPI_BPW_MASK(8) | SPI_BPW_MASK(16);
+	ctlr->max_transfer_size = ls020_selftest_max_transfer;
+	ctlr->transfer_one_message = ls020_selftest_transfer;
+	
+	ret = spi_register_controller(ctlr);
+	if (ret) {
+		spi_controller_put(ctlr);
+		goto parent_fail;
+	}
+	ctx->ctlr = ctlr;
+	
+	spi = spi_alloc_device(ctlr);
+	if (!spi) {
+		ret = -ENOMEM;
+		goto ctlr_fail;
+	}
+	strscpy(spi->modalias, DRIVER_NAME "_selftest", sizeof(spi->modalias));
+	ret = spi_add_device(spi);
+	if (ret) {
+		spi_dev_put(spi);
+		goto ctlr_fail;
+	}
+	
+	par->spi = spi;
+	par->stride = LS020_WIDTH;
+	par->videomemory = ctx->vmem;
+	mutex_init(&par->update_lock);
+	spin_lock_init(&par->ops_lock);
+	spin_lock_init(&par->stats_lock);
+	ls020_stats_reset(par);
+	
+	par->shadow_buffer = vzalloc(LS020_FRAME_SIZE);
+	ret = par->shadow_buffer ? ls020_flush_alloc(par) : -ENOMEM;
+	if (ret)
+		goto spi_fail;
+	return 0;
+	
+spi_fail:
+	ls020_flush_free(par);
+	vfree(par->shadow_buffer);
+	spi_unregister_device(spi);
+ctlr_fail:
+	spi_unregister_controller(ctlr);
+parent_fail:
+	root_device_unregister(ctx->parent);
+	return ret;
+}
+
+static void __init ls020_selftest_teardown(struct ls020_selftest_ctx *ctx)
+{
+	ls020_flush_free(&ctx->par);
+	vfree(ctx->par.shadow_buffer);
+	spi_unregister_device(ctx->par.spi);
+	spi_unregister_controller(ctx->ctlr);
+	root_device_unregister(ctx->parent);
+}
+
+/* In 8-bit colour mode the panel should show the converted framebuffer */
+static bool __init ls020_selftest_match(struct ls020_selftest_ctx *ctx)
+{
+	int x, y;
+	
+	if (!ctx->par.color8)
+		return !memcmp(ctx->model.image, ctx->vmem, LS020_FRAME_SIZE);
+	
+	for (y = 0; y < LS020_HEIGHT; y++)
+		for (x = 0; x < LS020_WIDTH; x++)
+			if (ctx->model.image[y * LS020_WIDTH + x] !=
+			    ls020_rgb332(ctx->vmem[y * LS020_WIDTH + x], x, y, ctx->par.dither))
+				return false;
+	return true;
+}
+
+/*
+ * Draws a rectangle. With @op it is queued as a 2D fill, as fillrect does,
+ * otherwise its rows are reported as written, as deferred I/O does.
+ */
+static void __init ls020_selftest_fill(struct ls020_selftest_ctx *ctx, int x, int y,
+				       int w, int h, u16 color, bool op)
+{
+	int i, j;
+	
+	w = min(w, LS020_WIDTH - x);
+	h = min(h, LS020_HEIGHT - y);
+	for (j = y; j < y + h; j++)
+		for (i = x; i < x + w; i++)
+			ctx->vmem[j * LS020_WIDTH + i] = color;
+	
+	if (op)
+		ls020_panel_queue_op(&ctx->par, LS020_OP_FILL, x, y, w, h);
+	else
+		for (j = y; j < y + h; j++)
+			set_bit(j, ctx->rows);
+}
+
+/* One flush of the driver, waiting until the controller has taken it all */
+static int __init ls020_selftest_flush(struct ls020_selftest_ctx *ctx)
+{
+	int ret;
+	
+	ret = ls020_update_display(&ctx->par, ctx->rows);
+	bitmap_zero(ctx->rows, LS020_HEIGHT);
+	return ret ?: ls020_flush_wait(&ctx->par);
+}
+
+static int __init ls020_selftest_reset(struct ls020_selftest_ctx *ctx, u8 orientation,
+				       bool partial, bool bpw16, bool color8, bool capture)
+{
+	struct ls020_fb_par *par = &ctx->par;
+	int ret;
+	
+	memset(&ctx->model, 0, sizeof(ctx->model));
+	memset(ctx->vmem, 0, sizeof(ctx->vmem));
+	bitmap_zero(ctx->rows, LS020_HEIGHT);
+	bitmap_zero(par->dirty_tiles, LS020_NUM_TILES);
+	par->nops = 0;
+	par->partial_update = partial;
+	par->pixel_bpw16 = bpw16 && !color8;
+	par->color8 = color8;
+	par->dither = color8 && bpw16;
+	par->window_set = false;
+	ctx->capture = capture;
+	
+	if (color8) {
+		u8 cmd[LS020_COLOR8_CMD_LEN];
+		
+		ls020_cmd_bytes(par, cmd, ls020_color8_cmds(cmd));
+		ret = ls020_cmd_flush(par);
+		if (ret)
+			return ret;
+	}
+	ret = ls020_set_rotation(par, orientation);
+	if (ret)
+		return ret;
+	
+	/* Probe sends one full frame, after which the shadow matches the panel */
+	ls020_mark_dirty_region(par, 0, 0, LS020_WIDTH, LS020_HEIGHT);
+	return ls020_selftest_flush(ctx);
+}
+
+/*
+ * Streams random damage and 2D fills through ls020_update_display() for
+ * rotations 0 and 2, the ones the panel model covers, for partial and full
+ * updates, both SPI word sizes and 8-bit colour with and without
+ * dithering, and checks that the panel model ends up showing exactly the
+ * framebuffer.
+ */
+static int __init ls020_stream_selftest(struct ls020_selftest_ctx *ctx)
+{
+	int mode, frame, i, n, ret;
+	
+	for (mode = 0; mode < 16; mode++) {
+		u8 orientation = (mode & 1) << 1;
+		bool partial = mode & 2;
+		bool bpw16 = mode & 4;
+		bool color8 = mode & 8;
+		
+		/* In 8-bit colour mode the word size bit selects dithering */
+		ret = ls020_selftest_reset(ctx, orientation, partial, bpw16, color8, true);
+		
+		for (frame = 0; frame < 64 && !ret; frame++) {
+			bool whole = frame % 16 == 15;
+			
+			n = whole ? 1 : 1 + get_random_u32() % 12;
+			for (i = 0; i < n; i++)
+				ls020_selftest_fill(ctx,
+						    whole ? 0 : get_random_u32() % LS020_WIDTH,
+						    whole ? 0 : get_random_u32() % LS020_HEIGHT,
+						    whole ? LS020_WIDTH : 1 + get_random_u32() % 48,
+						    whole ? LS020_HEIGHT : 1 + get_random_u32() % 48,
+						    get_random_u32(), get_random_u32() & 1);
+			ret = ls020_selftest_flush(ctx);
+			if (!ret && (ctx->model.errors || !ls020_selftest_match(ctx)))
+				ret = -EINVAL;
+		}
+		
+		if (ret) {
+			pr_err(DRIVER_NAME ": stream selftest failed: rotation %u, %s, %s, frame %d: %s (%d)\n",
+			       orientation, partial ? "partial" : "full",
+			       color8 ? (bpw16 ? "rgb332 dithered" : "rgb332") :
+			       (bpw16 ? "16-bit" : "8-bit"),
+			       frame, ctx->model.error ?: "image mismatch", ret);
+			return ret;
+		}
+	}
+	
+	pr_info(DRIVER_NAME ": stream selftest passed (rotations 0 and 2, partial/full, 8/16-bit, rgb332)\n");
+	return 0;
+}
+
+/*
+ * Times ls020_update_display() for the usual damage patterns, including
+ * queuing the transfers. The fake controller completes them right away, so
+ * wire time is left out; it depends only on the bytes moved.
+ */
+static void __init ls020_bench_selftest(struct ls020_selftest_ctx *ctx)
+{
+	static const char * const names[] = { "full", "sprites", "scroll", "corners", "idle" };
+	const int iters = 200;
+	int pattern, iter, i;
+	
+	for (pattern = 0; pattern < ARRAY_SIZE(names); pattern++) {
+		ktime_t start, total = 0;
+		
+		if (ls020_selftest_reset(ctx, 0, true, false, false, false))
+			return;
+		
+		for (iter = 1; iter <= iters; iter++) {
+			switch (pattern) {
+			case 0:
+				ls020_selftest_fill(ctx, 0, 0, LS020_WIDTH, LS020_HEIGHT, iter, false);
+				break;
+			case 1:
+				for (i = 0; i < 4; i++)
+					ls020_selftest_fill(ctx, (iter * (i + 2) + i * 37) % (LS020_WIDTH - 12),
+							    (iter * (i + 1) + i * 23) % (LS020_HEIGHT - 12),
+							    12, 12, iter + i, false);
+				break;
+			case 2:
+				memmove(ctx->vmem, ctx->vmem + LS020_WIDTH,
+					(LS020_HEIGHT - 1) * LS020_WIDTH * 2);
+				ls020_selftest_fill(ctx, 0, LS020_HEIGHT - 1, LS020_WIDTH, 1, iter, false);
+				bitmap_fill(ctx->rows, LS020_HEIGHT);
+				break;
+			case 3:
+				ls020_selftest_fill(ctx, (iter & 1) ? LS020_WIDTH - 8 : 0,
+						    (iter & 2) ? LS020_HEIGHT - 8 : 0, 8, 8, iter, false);
+				break;
+			default:
+				bitmap_fill(ctx->rows, LS020_HEIGHT);
+				break;
+			}
+			
+			start = ktime_get();
+			ls020_selftest_flush(ctx);
+			total = ktime_add(total, ktime_sub(ktime_get(), start));
+		}
+		
+		pr_info(DRIVER_NAME ": bench %-8s %6lld ns per frame\n", names[pattern],
+			div_s64(ktime_to_ns(total), iters));
+	}
+}
+
+static int __init ls020_selftest(void)
+{
+	struct ls020_selftest_ctx *ctx;
+	int ret;
+	
+	ret = ls020_diff_selftest();
+	if (ret)
+		return ret;
+	
+	ctx = vzalloc(sizeof(*ctx));
+	if (!ctx)
+		return -ENOMEM;
+	
+	ret = ls020_selftest_setup(ctx);
+	if (ret) {
+		pr_err(DRIVER_NAME ": couldn't set up the selftest SPI controller: %d\n", ret);
+		goto out;
+	}
+	
+	ret = ls020_stream_selftest(ctx);
+	if (!ret)
+		ls020_bench_selftest(ctx);
+	
+	ls020_selftest_teardown(ctx);
+out:
+	vfree(ctx);
+	return ret;
+}
+#else
+static inline int ls020_selftest(void)
+{
+	return 0;
+}
+#endif
+
+static int __init ls020_fb_init(void)
+{
+	int ret;
+	
+	ret = ls020_selftest();
+	if (ret)
+		return ret;
+	
+	ls020_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+	
+	ret = spi_register_driver(&ls020_fb_driver);
+	if (ret)
+		debugfs_remove_recursive(ls020_debugfs_root);
+	return ret;
+}
+module_init(ls020_fb_init);
+
+static void __exit ls020_fb_exit(void)
+{
+	spi_unregister_driver(&ls020_fb_driver);
+	debugfs_remove_recursive(ls020_debugfs_root);
+}
+module_exit(ls020_fb_exit);
 
 MODULE_DESCRIPTION("LS020 Siemens S65 TFT LCD framebuffer driver");
 MODULE_AUTHOR("Yaroslav Kashapov");
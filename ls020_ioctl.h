@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Userspace interface of the LS020 framebuffer driver
+ */
+#ifndef _LS020_IOCTL_H
+#define _LS020_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Damaged area in framebuffer coordinates */
+struct ls020_damage_rect {
+	__u16 x;
+	__u16 y;
+	__u16 width;
+	__u16 height;
+};
+
+/* Flush right away instead of at the next refresh tick */
+#define LS020_DAMAGE_FLUSH	(1 << 0)
+
+#define LS020_DAMAGE_MAX_RECTS	64
+
+/*
+ * Reports what a client redrew through mmap. Each rectangle is sent on its
+ * own, with no comparison against what the panel shows. From the first call
+ * on, page write tracking no longer triggers change detection: only reported
+ * rectangles are sent. This is a device-wide mode that applies to every
+ * client of the framebuffer, not just the caller, and lasts until the last
+ * userspace user closes the framebuffer.
+ */
+struct ls020_damage {
+	__u64 rects;		/* pointer to struct ls020_damage_rect[] */
+	__u32 num_rects;
+	__u32 flags;
+};
+
+#define LS020_IOCTL_DAMAGE	_IOW('F', 0x90, struct ls020_damage)
+
+/* Wait until the flush has been handed to the SPI controller */
+#define LS020_PRESENT_WAIT	(1 << 0)
+
+/*
+ * Sends what was drawn through mmap right away instead of at the next tick
+ * of the frame clock. Joins a flush that is already queued. Takes a __u32
+ * of LS020_PRESENT_* flags.
+ */
+#define LS020_IOCTL_PRESENT	_IOW('F', 0x91, __u32)
+
+#endif /* _LS020_IOCTL_H */
@@ -0,0 +1,485 @@
+/*
+ * Host-side simulator of the LS020 pixel pipeline.
+ *
+ * Runs the driver's change detection, update planning, packing and window
+ * setup from ls020_core.h against synthetic workloads. Everything that would
+ * go out over SPI lands in a mock sink, which decodes the command stream the
+ * way the panel does and rebuilds the image from the pixel data, so every
+ * frame can be checked against the framebuffer and its cost counted.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ls020_core.h"
+
+#define SIM_PAGE_SIZE 4096
+
+/* Mock SPI sink: counts traffic and feeds it to the panel model */
+struct sim_sink {
+	struct ls020_model model;
+	unsigned long long cmd_bytes;
+	unsigned long long data_bytes;
+	unsigned long long transfers;
+};
+
+/* Mirrors the parts of struct ls020_fb_par the flush path needs */
+struct sim_dev {
+	u16 vmem[LS020_WIDTH * LS020_HEIGHT] __attribute__((aligned(8)));
+	u16 shadow[LS020_WIDTH * LS020_HEIGHT] __attribute__((aligned(8)));
+	u8 txbuf[LS020_FRAME_SIZE];
+	DECLARE_BITMAP(dirty_tiles, LS020_NUM_TILES);
+	DECLARE_BITMAP(rows, LS020_HEIGHT);
+	u8 orientation;
+	bool partial_update;
+	bool pixel_bpw16;
+	bool color8;
+	bool dither;
+	bool window_set;
+
+	unsigned long partial_updates;
+	unsigned long full_updates;
+	unsigned long full_fallbacks;
+	double cpu_ns;
+
+	struct sim_sink sink;
+};
+
+static void sim_check(struct sim_sink *sink, unsigned long errors)
+{
+	if (sink->model.errors != errors && errors < 10)
+		fprintf(stderr, "sink: %s\n", sink->model.error);
+}
+
+static void sim_cmd(struct sim_dev *dev, const u8 *cmd, size_t len)
+{
+	struct sim_sink *sink = &dev->sink;
+	unsigned long errors = sink->model.errors;
+	
+	sink->cmd_bytes += len;
+	sink->transfers++;
+	ls020_model_cmd(&sink->model, cmd, len);
+	sim_check(sink, errors);
+}
+
+static void sim_data(struct sim_dev *dev, const void *buf, size_t len)
+{
+	struct sim_sink *sink = &dev->sink;
+	unsigned long errors = sink->model.errors;
+	
+	sink->data_bytes += len;
+	sink->transfers++;
+	ls020_model_data(&sink->model, buf, len, dev->pixel_bpw16);
+	sim_check(sink, errors);
+}
+
+static void sim_set_window(struct sim_dev *dev, u8 x0, u8 y0, u8 x1, u8 y1)
+{
+	u8 cmd[LS020_WINDOW_CMD_LEN];
+	
+	sim_cmd(dev, cmd, ls020_window_cmds(cmd, dev->orientation, x0, y0, x1, y1));
+}
+
+static size_t sim_bytes(struct sim_dev *dev, size_t pixels)
+{
+	return dev->color8 ? pixels : pixels * 2;
+}
+
+static void sim_pack(struct sim_dev *dev, u8 *dst, const u16 *src, int count, int x, int y)
+{
+	if (dev->color8)
+		ls020_pack_pixels8(dst, src, count, x, y, dev->dither);
+	else
+		ls020_pack_pixels(dst, src, count, dev->pixel_bpw16);
+}
+
+/* Packed rows go out in chunks, as in ls020_stream_rows() */
+static void sim_stream_rows(struct sim_dev *dev, int x0, int y0, int x1, int y1)
+{
+	int width = x1 - x0 + 1;
+	int rows = LS020_CHUNK_ROWS * LS020_WIDTH * 2 / sim_bytes(dev, width);
+	int y, i, n;
+	
+	for (y = y0; y <= y1; y += n) {
+		n = y1 - y + 1 < rows ? y1 - y + 1 : rows;
+		for (i = 0; i < n; i++) {
+			const u16 *src = dev->vmem + (y + i) * LS020_WIDTH + x0;
+			
+			if (dev->partial_update)
+				memcpy(dev->shadow + (y + i) * LS020_WIDTH + x0, src, width * 2);
+			sim_pack(dev, dev->txbuf + sim_bytes(dev, i * width), src, width,
+				 x0, y + i);
+		}
+		sim_data(dev, dev->txbuf, sim_bytes(dev, n * width));
+	}
+}
+
+static void sim_update_partial(struct sim_dev *dev, const struct ls020_rect *tr)
+{
+	struct ls020_rect px;
+	int width;
+	
+	ls020_tile_rect_pixels(tr, &px);
+	width = px.x1 - px.x0 + 1;
+	
+	sim_set_window(dev, px.x0, px.y0, px.x1, px.y1);
+	if (dev->pixel_bpw16 && width == LS020_WIDTH) {
+		memcpy(dev->shadow + px.y0 * LS020_WIDTH, dev->vmem + px.y0 * LS020_WIDTH,
+		       width * (px.y1 - px.y0 + 1) * 2);
+		sim_data(dev, dev->vmem + px.y0 * LS020_WIDTH, width * (px.y1 - px.y0 + 1) * 2);
+	} else {
+		sim_stream_rows(dev, px.x0, px.y0, px.x1, px.y1);
+	}
+	dev->window_set = false;
+}
+
+static void sim_update_full(struct sim_dev *dev)
+{
+	if (!dev->window_set) {
+		sim_set_window(dev, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
+		dev->window_set = true;
+	}
+	
+	if (!dev->pixel_bpw16) {
+		sim_stream_rows(dev, 0, 0, LS020_WIDTH - 1, LS020_HEIGHT - 1);
+		return;
+	}
+	
+	sim_data(dev, dev->vmem, LS020_FRAME_SIZE);
+	if (dev->partial_update)
+		memcpy(dev->shadow, dev->vmem, LS020_FRAME_SIZE);
+}
+
+/* Same decisions as ls020_update_display(), minus locking and queued ops */
+static void sim_update(struct sim_dev *dev)
+{
+	DECLARE_BITMAP(tiles, LS020_NUM_TILES);
+	struct ls020_rect rects[LS020_MAX_RECTS];
+	struct timespec t0, t1;
+	int i, nrects;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	
+	if (dev->partial_update) {
+		ls020_diff_rows(dev->vmem, LS020_WIDTH, dev->shadow, dev->rows, dev->dirty_tiles);
+		memcpy(tiles, dev->dirty_tiles, sizeof(tiles));
+		bitmap_zero(dev->dirty_tiles, LS020_NUM_TILES);
+		
+		nrects = ls020_plan_update(tiles, rects);
+		if (!nrects)
+			goto out;
+		if (nrects > 0) {
+			dev->partial_updates++;
+			for (i = 0; i < nrects; i++)
+				sim_update_partial(dev, &rects[i]);
+			goto out;
+		}
+		dev->full_fallbacks++;
+	}
+	
+	dev->full_updates++;
+	sim_update_full(dev);
+out:
+	bitmap_zero(dev->rows, LS020_HEIGHT);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	dev->cpu_ns += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+}
+
+/* Deferred I/O reports whole pages; mark every scanline they touch */
+static void sim_touch(struct sim_dev *dev, int y0, int y1)
+{
+	size_t first = (size_t)y0 * LS020_WIDTH * 2 / SIM_PAGE_SIZE;
+	size_t last = ((size_t)y1 * LS020_WIDTH * 2 + LS020_WIDTH * 2 - 1) / SIM_PAGE_SIZE;
+	size_t page;
+	int y;
+	
+	for (page = first; page <= last; page++) {
+		int py0 = page * SIM_PAGE_SIZE / (LS020_WIDTH * 2);
+		int py1 = ((page + 1) * SIM_PAGE_SIZE - 1) / (LS020_WIDTH * 2);
+		
+		for (y = py0; y <= py1 && y < LS020_HEIGHT; y++)
+			set_bit(y, dev->rows);
+	}
+}
+
+static void sim_fill(struct sim_dev *dev, int x, int y, int w, int h, u16 color)
+{
+	int i, j;
+	
+	if (x < 0)
+		w += x, x = 0;
+	if (y < 0)
+		h += y, y = 0;
+	if (x + w > LS020_WIDTH)
+		w = LS020_WIDTH - x;
+	if (y + h > LS020_HEIGHT)
+		h = LS020_HEIGHT - y;
+	if (w <= 0 || h <= 0)
+		return;
+	
+	for (j = y; j < y + h; j++)
+		for (i = x; i < x + w; i++)
+			dev->vmem[j * LS020_WIDTH + i] = color;
+	sim_touch(dev, y, y + h - 1);
+}
+
+static void wl_full(struct sim_dev *dev, unsigned long frame)
+{
+	int x, y;
+	
+	for (y = 0; y < LS020_HEIGHT; y++)
+		for (x = 0; x < LS020_WIDTH; x++)
+			dev->vmem[y * LS020_WIDTH + x] = (frame * 2654435761u) ^ (y << 8) ^ x;
+	sim_touch(dev, 0, LS020_HEIGHT - 1);
+}
+
+static void wl_sprites(struct sim_dev *dev, unsigned long frame)
+{
+	static const u16 colors[] = { 0xF800, 0x07E0, 0x001F, 0xFFE0 };
+	const int size = 12, span_x = LS020_WIDTH - size, span_y = LS020_HEIGHT - size;
+	int i, step;
+	
+	for (i = 0; i < 4; i++) {
+		for (step = 0; step < 2; step++) {
+			unsigned long t = frame - 1 + step;
+			int px = (t * (2 + i) + i * 37) % (2 * span_x);
+			int py = (t * (1 + i) + i * 23) % (2 * span_y);
+			
+			if (px >= span_x)
+				px = 2 * span_x - px;
+			if (py >= span_y)
+				py = 2 * span_y - py;
+			sim_fill(dev, px, py, size, size, step ? colors[i] : 0);
+		}
+	}
+}
+
+static void wl_scroll(struct sim_dev *dev, unsigned long frame)
+{
+	u16 *last = dev->vmem + (LS020_HEIGHT - 1) * LS020_WIDTH;
+	int x, row = frame % 8, line = frame / 8;
+	
+	memmove(dev->vmem, dev->vmem + LS020_WIDTH, (LS020_HEIGHT - 1) * LS020_WIDTH * 2);
+	for (x = 0; x < LS020_WIDTH; x++) {
+		u32 h = (line * 2654435761u) ^ ((x / 6) * 40503u);
+		
+		last[x] = (x % 6 < 5 && row < 7 && ((h >> ((row * 5 + x % 6) & 31)) & 1)) ?
+			  0xFFFF : 0x0000;
+	}
+	sim_touch(dev, 0, LS020_HEIGHT - 1);
+}
+
+static void wl_corners(struct sim_dev *dev, unsigned long frame)
+{
+	const int size = 8;
+	int corner = frame % 4;
+	
+	sim_fill(dev, (corner & 1) ? LS020_WIDTH - size : 0,
+		 (corner & 2) ? LS020_HEIGHT - size : 0, size, size,
+		 (frame / 4) & 1 ? 0x07FF : 0xF81F);
+}
+
+static void wl_random(struct sim_dev *dev, unsigned long frame)
+{
+	int i, n = 1 + rand() % 12;
+	
+	(void)frame;
+	for (i = 0; i < n; i++)
+		sim_fill(dev, rand() % LS020_WIDTH, rand() % LS020_HEIGHT,
+			 1 + rand() % 48, 1 + rand() % 48, rand());
+}
+
+static void wl_idle(struct sim_dev *dev, unsigned long frame)
+{
+	(void)frame;
+	/* Rewrite one page with identical content, as a redraw loop would */
+	sim_touch(dev, 0, 0);
+}
+
+static const struct {
+	const char *name;
+	void (*draw)(struct sim_dev *dev, unsigned long frame);
+} workloads[] = {
+	{ "full", wl_full },
+	{ "sprites", wl_sprites },
+	{ "scroll", wl_scroll },
+	{ "corners", wl_corners },
+	{ "random", wl_random },
+	{ "idle", wl_idle },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static void sim_init(struct sim_dev *dev, int orientation, bool partial, bool bpw16,
+		     bool color8, bool dither)
+{
+	u8 cmd[LS020_ROTATION_CMD_LEN];
+	
+	memset(dev, 0, sizeof(*dev));
+	dev->orientation = orientation;
+	dev->partial_update = partial;
+	dev->pixel_bpw16 = bpw16 && !color8;
+	dev->color8 = color8;
+	dev->dither = dither;
+	
+	if (color8)
+		sim_cmd(dev, cmd, ls020_color8_cmds(cmd));
+	sim_cmd(dev, cmd, ls020_rotation_cmds(cmd, orientation));
+	
+	/* Probe pushes one full frame, leaving panel and shadow in sync */
+	sim_update_full(dev);
+}
+
+/* In 8-bit colour mode the panel should show the converted framebuffer */
+static bool sim_match(struct sim_dev *dev)
+{
+	int x, y;
+	
+	if (!dev->color8)
+		return !memcmp(dev->sink.model.image, dev->vmem, LS020_FRAME_SIZE);
+	
+	for (y = 0; y < LS020_HEIGHT; y++)
+		for (x = 0; x < LS020_WIDTH; x++)
+			if (dev->sink.model.image[y * LS020_WIDTH + x] !=
+			    ls020_rgb332(dev->vmem[y * LS020_WIDTH + x], x, y, dev->dither))
+				return false;
+	return true;
+}
+
+static const char *sim_format(const struct sim_dev *dev)
+{
+	if (dev->color8)
+		return dev->dither ? "rgb332d" : "rgb332";
+	return dev->pixel_bpw16 ? "16-bit" : "8-bit";
+}
+
+static int run(const char *name, void (*draw)(struct sim_dev *, unsigned long),
+	       int orientation, bool partial, bool bpw16, bool color8, bool dither,
+	       unsigned long frames, bool csv)
+{
+	static struct sim_dev dev;
+	unsigned long f, bad_frames = 0;
+	struct sim_sink base;
+	
+	srand(1);
+	sim_init(&dev, orientation, partial, bpw16, color8, dither);
+	base = dev.sink;
+	dev.full_updates = 0;
+	
+	for (f = 1; f <= frames; f++) {
+		draw(&dev, f);
+		sim_update(&dev);
+		if (!sim_match(&dev))
+			bad_frames++;
+	}
+	
+	if (csv)
+		printf("%s,%d,%d,%s,%lu,%lu,%lu,%.1f,%.1f,%.2f,%.2f,%lu,%lu,%lu\n",
+		       name, orientation, partial, sim_format(&dev), frames, bad_frames,
+		       dev.sink.model.errors,
+		       (double)(dev.sink.cmd_bytes - base.cmd_bytes) / frames,
+		       (double)(dev.sink.data_bytes - base.data_bytes) / frames,
+		       (double)(dev.sink.transfers - base.transfers) / frames,
+		       dev.cpu_ns / frames / 1000.0,
+		       dev.partial_updates, dev.full_updates, dev.full_fallbacks);
+	else
+		printf("%-8s rot=%d %-7s %-7s: %s, %8.1f cmd + %8.1f data bytes, "
+		       "%5.2f transfers, %7.2f us per frame (partial %lu, full %lu, fallback %lu)\n",
+		       name, orientation, partial ? "partial" : "full", sim_format(&dev),
+		       bad_frames || dev.sink.model.errors ? "MISMATCH" : "ok",
+		       (double)(dev.sink.cmd_bytes - base.cmd_bytes) / frames,
+		       (double)(dev.sink.data_bytes - base.data_bytes) / frames,
+		       (double)(dev.sink.transfers - base.transfers) / frames,
+		       dev.cpu_ns / frames / 1000.0,
+		       dev.partial_updates, dev.full_updates, dev.full_fallbacks);
+	
+	return bad_frames || dev.sink.model.errors;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-r rotation|-a] [-n frames] [-F] [-8] [-C] [-D] [-c] [workload...]\n"
+		"  -r N  panel rotation 0 or 2 (default 0), -a runs both\n"
+		"  -n N  frames per workload (default 1000)\n"
+		"  -F    disable partial updates\n"
+		"  -8    8-bit SPI words instead of 16-bit\n"
+		"  -C    8-bit RGB332 colour mode, dithered\n"
+		"  -D    no dithering in 8-bit colour mode\n"
+		"  -c    CSV output\n"
+		"Workloads: full sprites scroll corners random idle (default: all)\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	int rot_first = 0, rot_last = 0, failed = 0, opt, r, i;
+	unsigned long frames = 1000;
+	bool partial = true, bpw16 = true, color8 = false, dither = true, csv = false;
+	size_t w;
+	
+	while ((opt = getopt(argc, argv, "r:an:F8CDch")) != -1) {
+		switch (opt) {
+		case 'r':
+			rot_first = rot_last = atoi(optarg) & 3;
+			if (rot_first & 1) {
+				/* See struct ls020_model: 90 and 270 degrees are not modelled */
+				fprintf(stderr, "%s: rotation %d is not modelled\n", argv[0], rot_first);
+				return 2;
+			}
+			break;
+		case 'a':
+			rot_first = 0;
+			rot_last = 2;
+			break;
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			partial = false;
+			break;
+		case '8':
+			bpw16 = false;
+			break;
+		case 'C':
+			color8 = true;
+			break;
+		case 'D':
+			dither = false;
+			break;
+		case 'c':
+			csv = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (!frames) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	if (csv)
+		printf("workload,rotation,partial,format,frames,bad_frames,stream_errors,"
+		       "cmd_bytes_per_frame,data_bytes_per_frame,transfers_per_frame,"
+		       "cpu_us_per_frame,partial_updates,full_updates,full_fallbacks\n");
+	
+	for (r = rot_first; r <= rot_last; r += 2) {
+		for (w = 0; w < NUM_WORKLOADS; w++) {
+			bool selected = optind == argc;
+			
+			for (i = optind; i < argc; i++)
+				if (!strcmp(argv[i], workloads[w].name))
+					selected = true;
+			if (selected)
+				failed |= run(workloads[w].name, workloads[w].draw, r, partial,
+					      bpw16, color8, dither, frames, csv);
+		}
+	}
+	
+	return failed;
+}
@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Trace events for the LS020 framebuffer driver
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ls020
+
+#if !defined(_LS020_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _LS020_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ls020_defio,
+	TP_PROTO(const struct device *dev, unsigned int pages),
+	TP_ARGS(dev, pages),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(unsigned int, pages)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->pages = pages;
+	),
+
+	TP_printk("%s pages=%u", __entry->dev, __entry->pages)
+);
+
+TRACE_EVENT(ls020_detect_start,
+	TP_PROTO(const struct device *dev, unsigned int rows),
+	TP_ARGS(dev, rows),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(unsigned int, rows)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->rows = rows;
+	),
+
+	TP_printk("%s rows=%u", __entry->dev, __entry->rows)
+);
+
+TRACE_EVENT(ls020_detect_end,
+	TP_PROTO(const struct device *dev, unsigned int tiles,
+		 u8 x0, u8 y0, u8 x1, u8 y1),
+	TP_ARGS(dev, tiles, x0, y0, x1, y1),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(unsigned int, tiles)
+		__field(u8, x0)
+		__field(u8, y0)
+		__field(u8, x1)
+		__field(u8, y1)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->tiles = tiles;
+		__entry->x0 = x0;
+		__entry->y0 = y0;
+		__entry->x1 = x1;
+		__entry->y1 = y1;
+	),
+
+	TP_printk("%s tiles=%u dirty=(%u,%u)-(%u,%u)", __entry->dev, __entry->tiles,
+		  __entry->x0, __entry->y0, __entry->x1, __entry->y1)
+);
+
+DECLARE_EVENT_CLASS(ls020_rect,
+	TP_PROTO(const struct device *dev, u8 x0, u8 y0, u8 x1, u8 y1),
+	TP_ARGS(dev, x0, y0, x1, y1),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(u8, x0)
+		__field(u8, y0)
+		__field(u8, x1)
+		__field(u8, y1)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->x0 = x0;
+		__entry->y0 = y0;
+		__entry->x1 = x1;
+		__entry->y1 = y1;
+	),
+
+	TP_printk("%s (%u,%u)-(%u,%u)", __entry->dev,
+		  __entry->x0, __entry->y0, __entry->x1, __entry->y1)
+);
+
+DEFINE_EVENT(ls020_rect, ls020_window,
+	TP_PROTO(const struct device *dev, u8 x0, u8 y0, u8 x1, u8 y1),
+	TP_ARGS(dev, x0, y0, x1, y1)
+);
+
+DEFINE_EVENT(ls020_rect, ls020_update_partial,
+	TP_PROTO(const struct device *dev, u8 x0, u8 y0, u8 x1, u8 y1),
+	TP_ARGS(dev, x0, y0, x1, y1)
+);
+
+DEFINE_EVENT(ls020_rect, ls020_update_full,
+	TP_PROTO(const struct device *dev, u8 x0, u8 y0, u8 x1, u8 y1),
+	TP_ARGS(dev, x0, y0, x1, y1)
+);
+
+DECLARE_EVENT_CLASS(ls020_xfer,
+	TP_PROTO(const struct device *dev, size_t len, int status),
+	TP_ARGS(dev, len, status),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(size_t, len)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->len = len;
+		__entry->status = status;
+	),
+
+	TP_printk("%s len=%zu status=%d", __entry->dev, __entry->len, __entry->status)
+);
+
+DEFINE_EVENT(ls020_xfer, ls020_cmd_write,
+	TP_PROTO(const struct device *dev, size_t len, int status),
+	TP_ARGS(dev, len, status)
+);
+
+DEFINE_EVENT(ls020_xfer, ls020_spi_submit,
+	TP_PROTO(const struct device *dev, size_t len, int status),
+	TP_ARGS(dev, len, status)
+);
+
+DEFINE_EVENT(ls020_xfer, ls020_spi_complete,
+	TP_PROTO(const struct device *dev, size_t len, int status),
+	TP_ARGS(dev, len, status)
+);
+
+TRACE_EVENT(ls020_fillrect,
+	TP_PROTO(const struct device *dev, const struct fb_fillrect *rect),
+	TP_ARGS(dev, rect),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(u32, dx)
+		__field(u32, dy)
+		__field(u32, width)
+		__field(u32, height)
+		__field(u32, color)
+		__field(u32, rop)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->dx = rect->dx;
+		__entry->dy = rect->dy;
+		__entry->width = rect->width;
+		__entry->height = rect->height;
+		__entry->color = rect->color;
+		__entry->rop = rect->rop;
+	),
+
+	TP_printk("%s %ux%u@(%u,%u) color=%u rop=%u", __entry->dev,
+		  __entry->width, __entry->height, __entry->dx, __entry->dy,
+		  __entry->color, __entry->rop)
+);
+
+TRACE_EVENT(ls020_imageblit,
+	TP_PROTO(const struct device *dev, const struct fb_image *image),
+	TP_ARGS(dev, image),
+
+	TP_STRUCT__entry(
+		__array(char, dev, 16)
+		__field(u32, dx)
+		__field(u32, dy)
+		__field(u32, width)
+		__field(u32, height)
+		__field(u8, depth)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(dev), sizeof(__entry->dev));
+		__entry->dx = image->dx;
+		__entry->dy = image->dy;
+		__entry->width = image->width;
+		__entry->height = image->height;
+		__entry->depth = image->depth;
+	),
+
+	TP_printk("%s %ux%u@(%u,%u) depth=%u", __entry->dev,
+		  __entry->width, __entry->height, __entry->dx, __entry->dy,
+		  __entry->depth)
+);
+
+#endif /* _LS020_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ls020_trace
+#include <trace/define_trace.h>
@@ -1,10 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <linux/fb.h>
 
 #define FB_WIDTH 176
 #define FB_HEIGHT 132
@@ -141,7 +147,471 @@ void test_graphics(uint16_t *fb) {
     fill_screen(fb, COLOR_BLACK);
 }
 
+/*
+ * Режим бенчмарка: повторяемые нагрузки на /dev/fbN с машиночитаемым
+ * выводом (CSV/JSON) для сравнения сборок драйвера и плат.
+ */
+
+#define BENCH_MAX_SAMPLES 4096
+#define BENCH_POLL_NS 250000L
+
+struct bench_fb {
+    uint16_t *mem;
+    size_t size;
+    int width;
+    int height;
+    int stride;     // в пикселях
+    char stats_dir[128];
+};
+
+struct bench_stats {
+    int valid;
+    unsigned long long frames_flushed;
+    unsigned long long frames_skipped;
+    unsigned long long partial_updates;
+    unsigned long long full_updates;
+    unsigned long long full_fallbacks;
+    unsigned long long bytes_sent;
+};
+
+struct bench_result {
+    const char *workload;
+    double duration;
+    unsigned long frames_drawn;
+    double app_fps;
+    struct bench_stats delta;
+    double lat_avg, lat_p50, lat_p95, lat_max;   // мс, < 0 если нет данных
+    int lat_count;
+    double cpu_pct;                               // < 0 если нет данных
+};
+
+struct bench_opts {
+    const char *device;
+    double duration;
+    int rate;
+    int json;
+    int worker_pid;
+};
+
+struct bench_workload {
+    const char *name;
+    int (*draw)(struct bench_fb *fb, unsigned long frame);   // 0 = ничего не рисовали
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_ull(const char *dir, const char *name, unsigned long long *val) {
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    int ok = fscanf(f, "%llu", val) == 1;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static void read_stats(const struct bench_fb *fb, struct bench_stats *st) {
+    memset(st, 0, sizeof(*st));
+    st->valid =
+        read_ull(fb->stats_dir, "frames_flushed", &st->frames_flushed) == 0 &&
+        read_ull(fb->stats_dir, "frames_skipped", &st->frames_skipped) == 0 &&
+        read_ull(fb->stats_dir, "partial_updates", &st->partial_updates) == 0 &&
+        read_ull(fb->stats_dir, "full_updates", &st->full_updates) == 0 &&
+        read_ull(fb->stats_dir, "full_fallbacks", &st->full_fallbacks) == 0 &&
+        read_ull(fb->stats_dir, "bytes_sent", &st->bytes_sent) == 0;
+}
+
+// Тики CPU: занятость всей системы либо конкретного потока (--worker)
+static long long cpu_ticks(int worker_pid) {
+    char buf[512];
+    FILE *f;
+
+    if (worker_pid > 0) {
+        snprintf(buf, sizeof(buf), "/proc/%d/stat", worker_pid);
+        f = fopen(buf, "r");
+        if (!f)
+            return -1;
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = 0;
+
+        // utime и stime - поля 14 и 15, считаем после имени процесса
+        char *p = strrchr(buf, ')');
+        unsigned long long utime, stime;
+        if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                         &utime, &stime) != 2)
+            return -1;
+        return utime + stime;
+    }
+
+    f = fopen("/proc/stat", "r");
+    if (!f)
+        return -1;
+    unsigned long long user, nice, sys, idle, iowait, irq, softirq, steal = 0;
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &user, &nice, &sys, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(f);
+    if (n < 7)
+        return -1;
+
+    // Без учета самого бенчмарка
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double self = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+                  ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    return (long long)(user + nice + sys + irq + softirq + steal) -
+           (long long)(self * sysconf(_SC_CLK_TCK));
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_fill(struct bench_fb *fb, int x, int y, int w, int h, uint16_t color) {
+    for (int j = y; j < y + h && j < fb->height; j++)
+        for (int i = x; i < x + w && i < fb->width; i++)
+            if (i >= 0 && j >= 0)
+                fb->mem[j * fb->stride + i] = color;
+}
+
+// Полная перерисовка экрана каждый кадр
+static int draw_full(struct bench_fb *fb, unsigned long frame) {
+    for (int y = 0; y < fb->height; y++) {
+        uint16_t color = rgb_to_rgb565(frame * 4, y * 2, 255 - frame * 4);
+        for (int x = 0; x < fb->width; x++)
+            fb->mem[y * fb->stride + x] = color ^ x;
+    }
+    return 1;
+}
+
+// Несколько маленьких спрайтов, отскакивающих от краев
+static int draw_sprites(struct bench_fb *fb, unsigned long frame) {
+    static const uint16_t colors[] = {COLOR_RED, COLOR_GREEN, COLOR_BLUE, COLOR_YELLOW};
+    const int size = 12;
+
+    for (int i = 0; i < 4; i++) {
+        int span_x = fb->width - size, span_y = fb->height - size;
+        for (int step = 0; step < 2; step++) {
+            unsigned long t = frame - 1 + step;
+            int px = (t * (2 + i) + i * 37) % (2 * span_x);
+            int py = (t * (1 + i) + i * 23) % (2 * span_y);
+            if (px >= span_x) px = 2 * span_x - px;
+            if (py >= span_y) py = 2 * span_y - py;
+            // Стираем старую позицию, рисуем новую
+            bench_fill(fb, px, py, size, size, step ? colors[i] : COLOR_BLACK);
+        }
+    }
+    return 1;
+}
+
+// Прокрутка текста вверх на одну строку пикселей
+static int draw_scroll(struct bench_fb *fb, unsigned long frame) {
+    const int line_h = 8;
+
+    memmove(fb->mem, fb->mem + fb->stride, (fb->height - 1) * fb->stride * 2);
+
+    // Псевдоглифы 5x7 из хеша номера строки и колонки
+    int line = frame / line_h, row = frame % line_h;
+    uint16_t *dst = fb->mem + (fb->height - 1) * fb->stride;
+    for (int x = 0; x < fb->width; x++) {
+        int col = x / 6, gx = x % 6;
+        uint32_t h = (line * 2654435761u) ^ (col * 40503u);
+        int on = gx < 5 && row < 7 && ((h >> ((row * 5 + gx) & 31)) & 1) && (h % 7);
+        dst[x] = on ? COLOR_WHITE : COLOR_BLACK;
+    }
+    return 1;
+}
+
+// Редкие мелкие обновления в углах экрана
+static int draw_corners(struct bench_fb *fb, unsigned long frame) {
+    const int size = 8;
+    int corner = frame % 4;
+    int x = (corner & 1) ? fb->width - size : 0;
+    int y = (corner & 2) ? fb->height - size : 0;
+
+    bench_fill(fb, x, y, size, size, (frame / 4) & 1 ? COLOR_CYAN : COLOR_MAGENTA);
+    return 1;
+}
+
+// Ничего не рисуем: базовая нагрузка драйвера
+static int draw_idle(struct bench_fb *fb, unsigned long frame) {
+    (void)fb;
+    (void)frame;
+    return 0;
+}
+
+static const struct bench_workload workloads[] = {
+    {"full", draw_full},
+    {"sprites", draw_sprites},
+    {"scroll", draw_scroll},
+    {"corners", draw_corners},
+    {"idle", draw_idle},
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/*
+ * Задержка "запись -> экран" оценивается как время от записи кадра до
+ * следующего приращения stats/frames_flushed в драйвере.
+ */
+static void run_workload(struct bench_fb *fb, const struct bench_workload *wl,
+                         const struct bench_opts *opts, struct bench_result *res) {
+    static double samples[BENCH_MAX_SAMPLES];
+    struct bench_stats before, after;
+    double period = 1.0 / opts->rate;
+    int nsamples = 0, probe = 0;
+    unsigned long long probe_count = 0;
+    double probe_time = 0;
+    unsigned long frame = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->workload = wl->name;
+
+    bench_fill(fb, 0, 0, fb->width, fb->height, COLOR_BLACK);
+    sleep(1);
+
+    read_stats(fb, &before);
+    long long cpu_start = cpu_ticks(opts->worker_pid);
+    double start = now_sec(), deadline = start;
+
+    while (now_sec() - start < opts->duration) {
+        frame++;
+        if (wl->draw(fb, frame)) {
+            res->frames_drawn++;
+            if (!probe && before.valid) {
+                struct bench_stats st;
+                read_stats(fb, &st);
+                probe_count = st.frames_flushed;
+                probe_time = now_sec();
+                probe = 1;
+            }
+        }
+
+        // Ждем следующий кадр, опрашивая счетчик драйвера
+        deadline += period;
+        for (double t = now_sec(); t < deadline; t = now_sec()) {
+            double wait = deadline - t;
+            if (probe) {
+                unsigned long long flushed;
+                if (read_ull(fb->stats_dir, "frames_flushed", &flushed) == 0 &&
+                    flushed != probe_count) {
+                    if (nsamples < BENCH_MAX_SAMPLES)
+                        samples[nsamples++] = (t - probe_time) * 1000.0;
+                    probe = 0;
+                    continue;
+                }
+                if (wait > BENCH_POLL_NS / 1e9)
+                    wait = BENCH_POLL_NS / 1e9;
+            }
+            struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    // Даем драйверу досбросить последний кадр
+    struct timespec settle = {0, 200000000L};
+    nanosleep(&settle, NULL);
+    res->duration = now_sec() - start;
+    long long cpu_end = cpu_ticks(opts->worker_pid);
+    read_stats(fb, &after);
+
+    res->app_fps = res->frames_drawn / opts->duration;
+    res->delta.valid = before.valid && after.valid;
+    res->delta.frames_flushed = after.frames_flushed - before.frames_flushed;
+    res->delta.frames_skipped = after.frames_skipped - before.frames_skipped;
+    res->delta.partial_updates = after.partial_updates - before.partial_updates;
+    res->delta.full_updates = after.full_updates - before.full_updates;
+    res->delta.full_fallbacks = after.full_fallbacks - before.full_fallbacks;
+    res->delta.bytes_sent = after.bytes_sent - before.bytes_sent;
+
+    res->cpu_pct = -1;
+    if (cpu_start >= 0 && cpu_end >= 0)
+        res->cpu_pct = 100.0 * (cpu_end - cpu_start) / sysconf(_SC_CLK_TCK) / res->duration;
+
+    res->lat_avg = res->lat_p50 = res->lat_p95 = res->lat_max = -1;
+    res->lat_count = nsamples;
+    if (nsamples) {
+        double sum = 0;
+        qsort(samples, nsamples, sizeof(samples[0]), cmp_double);
+        for (int i = 0; i < nsamples; i++)
+            sum += samples[i];
+        res->lat_avg = sum / nsamples;
+        res->lat_p50 = samples[nsamples / 2];
+        res->lat_p95 = samples[(nsamples * 95) / 100];
+        res->lat_max = samples[nsamples - 1];
+    }
+}
+
+// Отрицательные значения - "нет данных"
+static void print_num(int json, double v, int decimals) {
+    if (v < 0)
+        fputs(json ? "null" : "", stdout);
+    else
+        printf("%.*f", decimals, v);
+}
+
+static void print_results(const struct bench_result *res, int count, const struct bench_opts *opts) {
+    static const char *cols[] = {
+        "workload", "duration_s", "frames_drawn", "app_fps", "driver_fps",
+        "latency_avg_ms", "latency_p50_ms", "latency_p95_ms", "latency_max_ms",
+        "latency_samples", "cpu_pct", "bytes_per_frame", "frames_flushed",
+        "frames_skipped", "partial_updates", "full_updates", "full_fallbacks",
+        "bytes_sent",
+    };
+    const int ncols = sizeof(cols) / sizeof(cols[0]);
+
+    if (opts->json)
+        printf("[\n");
+    else
+        for (int c = 0; c < ncols; c++)
+            printf("%s%s", cols[c], c == ncols - 1 ? "\n" : ",");
+
+    for (int i = 0; i < count; i++) {
+        const struct bench_result *r = &res[i];
+        const struct bench_stats *d = &r->delta;
+        double vals[] = {
+            r->duration, r->frames_drawn, r->app_fps,
+            d->valid ? (double)d->frames_flushed / r->duration : -1,
+            r->lat_avg, r->lat_p50, r->lat_p95, r->lat_max, r->lat_count, r->cpu_pct,
+            d->valid && d->frames_flushed ? (double)d->bytes_sent / d->frames_flushed : -1,
+            d->valid ? (double)d->frames_flushed : -1, d->valid ? (double)d->frames_skipped : -1,
+            d->valid ? (double)d->partial_updates : -1, d->valid ? (double)d->full_updates : -1,
+            d->valid ? (double)d->full_fallbacks : -1, d->valid ? (double)d->bytes_sent : -1,
+        };
+        static const int decimals[] = {3, 0, 2, 2, 3, 3, 3, 3, 0, 2, 1, 0, 0, 0, 0, 0, 0};
+
+        if (opts->json)
+            printf("  {\"%s\": \"%s\"", cols[0], r->workload);
+        else
+            printf("%s", r->workload);
+
+        for (int c = 1; c < ncols; c++) {
+            if (opts->json)
+                printf(", \"%s\": ", cols[c]);
+            else
+                printf(",");
+            print_num(opts->json, vals[c - 1], decimals[c - 1]);
+        }
+
+        if (opts->json)
+            printf("}%s\n", i == count - 1 ? "" : ",");
+        else
+            printf("\n");
+    }
+
+    if (opts->json)
+        printf("]\n");
+}
+
+static void bench_usage(void) {
+    fprintf(stderr,
+            "Использование: test_lcd bench [опции] [нагрузка...]\n"
+            "  -d /dev/fbN   устройство (по умолчанию /dev/fb0)\n"
+            "  -t SEC        длительность каждой нагрузки (по умолчанию 10)\n"
+            "  -r FPS        частота кадров приложения (по умолчанию 60)\n"
+            "  -j            вывод в JSON вместо CSV\n"
+            "  -w PID        считать CPU этого потока вместо всей системы\n"
+            "Нагрузки: full sprites scroll corners idle (по умолчанию все)\n");
+}
+
+static int run_bench(int argc, char *argv[]) {
+    struct bench_opts opts = {"/dev/fb0", 10.0, 60, 0, 0};
+    struct bench_result results[NUM_WORKLOADS];
+    const struct bench_workload *selected[NUM_WORKLOADS];
+    struct fb_var_screeninfo var;
+    struct fb_fix_screeninfo fix;
+    struct bench_fb fb;
+    int nselected = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:t:r:jw:h")) != -1) {
+        switch (opt) {
+        case 'd': opts.device = optarg; break;
+        case 't': opts.duration = atof(optarg); break;
+        case 'r': opts.rate = atoi(optarg); break;
+        case 'j': opts.json = 1; break;
+        case 'w': opts.worker_pid = atoi(optarg); break;
+        default:
+            bench_usage();
+            return 1;
+        }
+    }
+    if (opts.duration <= 0 || opts.rate <= 0) {
+        bench_usage();
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        size_t w;
+        for (w = 0; w < NUM_WORKLOADS; w++)
+            if (strcmp(argv[i], workloads[w].name) == 0)
+                break;
+        if (w == NUM_WORKLOADS || nselected == (int)NUM_WORKLOADS) {
+            fprintf(stderr, "Неизвестная нагрузка: %s\n", argv[i]);
+            bench_usage();
+            return 1;
+        }
+        selected[nselected++] = &workloads[w];
+    }
+    if (!nselected)
+        for (size_t w = 0; w < NUM_WORKLOADS; w++)
+            selected[nselected++] = &workloads[w];
+
+    int fd = open(opts.device, O_RDWR);
+    if (fd < 0) {
+        perror(opts.device);
+        return 1;
+    }
+    if (ioctl(fd, FBIOGET_VSCREENINFO, &var) < 0 || ioctl(fd, FBIOGET_FSCREENINFO, &fix) < 0) {
+        perror("FBIOGET_*SCREENINFO");
+        close(fd);
+        return 1;
+    }
+
+    fb.width = var.xres;
+    fb.height = var.yres;
+    fb.stride = fix.line_length / 2;
+    fb.size = fix.smem_len;
+    fb.mem = mmap(NULL, fb.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fb.mem == MAP_FAILED) {
+        perror("Ошибка mmap");
+        close(fd);
+        return 1;
+    }
+
+    const char *name = strrchr(opts.device, '/');
+    snprintf(fb.stats_dir, sizeof(fb.stats_dir), "/sys/class/graphics/%s/device/stats",
+             name ? name + 1 : opts.device);
+
+    struct bench_stats probe;
+    read_stats(&fb, &probe);
+    if (!probe.valid)
+        fprintf(stderr, "Статистика драйвера недоступна (%s), часть полей будет пустой\n",
+                fb.stats_dir);
+
+    for (int i = 0; i < nselected; i++) {
+        fprintf(stderr, "Нагрузка %s: %.0f с при %d fps\n", selected[i]->name,
+                opts.duration, opts.rate);
+        run_workload(&fb, selected[i], &opts, &results[i]);
+    }
+
+    print_results(results, nselected, &opts);
+
+    munmap(fb.mem, fb.size);
+    close(fd);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return run_bench(argc - 1, argv + 1);
+    
     printf("LS020 Framebuffer Test\n");
     printf("======================\n");
     